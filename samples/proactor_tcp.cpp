@@ -1,8 +1,25 @@
 #include "proactor.hpp"
+#include "http.hpp"
 
-int main()
+template <typename Protocol>
+int serve(int profile)
 {
-    Proactor proactor;
-    int n = proactor.run("0.0.0.0", 8080);
+    MultiProactor<Peer_tcp, Protocol> proactor;
+    int n = proactor.run("0.0.0.0", 8080, 511, 512, 1024, 256, 256, 256, 1024, 4096,
+                         true, 64 * 1024, false,
+                         static_cast<typename Proactor<Peer_tcp, Protocol>::Profile>(profile));
     return n;
 }
+
+// ./proactor_tcp [profile] [http]
+// 0 DEFAULT, 1 THROUGHPUT, 2 LATENCY
+// http answers HTTP/1.1 instead of echoing
+int main(int argc, char *argv[])
+{
+    int profile = Proactor<Peer_tcp>::DEFAULT;
+    if (argc > 1)
+        profile = std::stoi(argv[1]);
+    if (argc > 2 && std::string_view(argv[2]) == "http")
+        return serve<Http<>>(profile);
+    return serve<Reflect>(profile);
+}
@@ -0,0 +1,8 @@
+#include "proactor.hpp"
+
+int main()
+{
+    MultiProactor<Peer_tls> proactor;
+    int n = proactor.run("0.0.0.0", 8443, "../certs/ser.crt", "../certs/ser.key");
+    return n;
+}
@@ -1,8 +1,16 @@
 #include "reactor.hpp"
+#include "http.hpp"
 
-int main()
+// ./reactor_tcp [http]
+// http answers HTTP/1.1 instead of echoing
+int main(int argc, char *argv[])
 {
-    Reactor<Peer_tcp> reactor;
+    if (argc > 1 && std::string_view(argv[1]) == "http")
+    {
+        MultiReactor<Peer_tcp, Http<>> reactor;
+        return reactor.run("0.0.0.0", 8080);
+    }
+    MultiReactor<Peer_tcp> reactor;
     int n = reactor.run("0.0.0.0", 8080);
     return n;
 }
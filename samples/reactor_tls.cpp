@@ -2,7 +2,7 @@
 
 int main()
 {
-    Reactor<Peer_tls> reactor;
+    MultiReactor<Peer_tls> reactor;
     int n = reactor.run("0.0.0.0", 4433, "../certs/ser.crt", "../certs/ser.key");
     return n;
-}
\ No newline at end of file
+}
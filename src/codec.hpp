@@ -0,0 +1,205 @@
+#pragma once
+
+#include <string_view>
+#include <span>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "concepts.hpp"
+
+// a frame at the front of the received bytes
+// size 0: incomplete, need the bytes still missing if known, 0 otherwise
+// scanned the leading bytes a codec with frame(data, scanned) needn't search again
+// isError: the stream can't be framed, e.g. a frame over maxLength
+struct Frame
+{
+    size_t offset = 0;
+    size_t length = 0;
+    size_t size = 0;
+    size_t need = 0;
+    bool isError = false;
+    size_t scanned = 0;
+};
+template <typename Codec>
+concept is_codec = std::default_initializable<Codec> &&
+                   requires(const Codec codec, std::span<const char> data) {{ codec.frame(data) } -> std::same_as<Frame>; };
+template <typename Message>
+concept is_message = std::default_initializable<Message> &&
+                     requires(Message message, std::string_view data, Handler &handler) { message.on_message(data, handler); };
+
+// first c in data, data.size() none
+// 32 bytes a step with AVX2, 16 with SSE2, bytewise for the rest
+class Scan
+{
+#if defined(__x86_64__)
+    __attribute__((target("avx2"))) static size_t avx2(const char *data, size_t len, char c) noexcept
+    {
+        size_t i = 0;
+        __m256i needle = _mm256_set1_epi8(c);
+        for (; i + 32 <= len; i += 32)
+        {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+            unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+            if (mask != 0)
+                return i + __builtin_ctz(mask);
+        }
+        return i + sse2(data + i, len - i, c);
+    }
+    static size_t sse2(const char *data, size_t len, char c) noexcept
+    {
+        size_t i = 0;
+        __m128i needle = _mm_set1_epi8(c);
+        for (; i + 16 <= len; i += 16)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+            if (mask != 0)
+                return i + __builtin_ctz(mask);
+        }
+        return i + scalar(data + i, len - i, c);
+    }
+#endif
+    static size_t scalar(const char *data, size_t len, char c) noexcept
+    {
+        for (size_t i = 0; i < len; ++i)
+            if (data[i] == c)
+                return i;
+        return len;
+    }
+
+public:
+    static size_t find(std::span<const char> data, char c) noexcept
+    {
+#if defined(__x86_64__)
+        static const bool isAvx2 = __builtin_cpu_supports("avx2");
+        if (isAvx2)
+            return avx2(data.data(), data.size(), c);
+        return sse2(data.data(), data.size(), c);
+#else
+        return scalar(data.data(), data.size(), c);
+#endif
+    }
+};
+
+// big-endian length header of Bytes bytes, the payload follows
+template <size_t Bytes = 4>
+struct FixedPrefix
+{
+    static_assert(Bytes == 1 || Bytes == 2 || Bytes == 4 || Bytes == 8,
+                  "FixedPrefix<Bytes>: Bytes must be 1, 2, 4 or 8");
+    size_t maxLength = 16 * 1024 * 1024;
+    inline Frame frame(std::span<const char> data) const noexcept
+    {
+        if (data.size() < Bytes)
+            return {0, 0, 0, Bytes - data.size(), false};
+        uint64_t length = 0;
+        for (size_t i = 0; i < Bytes; ++i)
+            length = (length << 8) | static_cast<unsigned char>(data[i]);
+        if (length > maxLength)
+            return {0, 0, 0, 0, true};
+        if (data.size() < Bytes + length)
+            return {0, 0, 0, Bytes + length - data.size(), false};
+        return {Bytes, length, Bytes + length, 0, false};
+    }
+};
+// LEB128 length header of up to 10 bytes, the payload follows
+struct VarintPrefix
+{
+    size_t maxLength = 16 * 1024 * 1024;
+    inline Frame frame(std::span<const char> data) const noexcept
+    {
+        uint64_t length = 0;
+        size_t i = 0;
+        for (; i < data.size() && i < 10; ++i)
+        {
+            unsigned char byte = static_cast<unsigned char>(data[i]);
+            length |= static_cast<uint64_t>(byte & 0x7f) << (7 * i);
+            if ((byte & 0x80) == 0)
+                break;
+        }
+        if (i == 10)
+            return {0, 0, 0, 0, true};
+        if (i == data.size())
+            return {0, 0, 0, 1, false};
+        if (length > maxLength)
+            return {0, 0, 0, 0, true};
+        size_t header = i + 1;
+        if (data.size() < header + length)
+            return {0, 0, 0, header + length - data.size(), false};
+        return {header, length, header + length, 0, false};
+    }
+};
+// messages end with delimiter, e.g. "\n" or "\r\n", the payload excludes it
+// the scan looks for its last byte, then checks the ones before
+// a line arriving in pieces is searched from where the last try stopped
+struct Delimiter
+{
+    std::string_view delimiter = "\n";
+    size_t maxLength = 64 * 1024;
+    inline Frame frame(std::span<const char> data, size_t scanned = 0) const noexcept
+    {
+        if (delimiter.empty())
+            return {0, 0, 0, 0, true};
+        size_t tail = delimiter.size() - 1;
+        size_t from = std::max(tail, scanned);
+        while (from < data.size())
+        {
+            size_t i = from + Scan::find(data.subspan(from), delimiter.back());
+            if (i == data.size())
+                break;
+            if (std::memcmp(data.data() + i - tail, delimiter.data(), tail) == 0)
+            {
+                if (i - tail > maxLength)
+                    return {0, 0, 0, 0, true};
+                return {0, i - tail, i + 1, 0, false};
+            }
+            from = i + 1;
+        }
+        if (data.size() > maxLength + delimiter.size())
+            return {0, 0, 0, 0, true};
+        return {0, 0, 0, 0, false, data.size()};
+    }
+};
+
+// frames the stream for Message::on_message(std::string_view, Handler &), whole frames only
+// a frame inside one receive chunk is handed over in place, one across chunks
+// is joined first, see Handler::process()
+// the missing bytes of a pending frame become the wakeup hint, see Handler::expectRecv()
+// how far its search got is kept in the handler's mark
+// a stream that can't be framed is dropped and the connection closes after the earlier responses
+template <is_codec Codec, is_message Message>
+struct Framed
+{
+    Codec codec{};
+    Message message{};
+    inline size_t on_data(std::span<const char> data, Handler &handler)
+    {
+        size_t sum = 0;
+        while (sum < data.size())
+        {
+            Frame frame;
+            if constexpr (requires { codec.frame(data, size_t{}); })
+                frame = codec.frame(data.subspan(sum), handler.markOffset() > sum ? handler.markOffset() - sum : 0);
+            else
+                frame = codec.frame(data.subspan(sum));
+            if (frame.isError)
+            {
+                fprintf(stderr, "Framed::on_data() Error\n"); //
+                handler.closeAfterResponse();
+                return data.size();
+            }
+            if (frame.size == 0)
+            {
+                handler.expectRecv(frame.need);
+                handler.mark(sum + frame.scanned);
+                break;
+            }
+            message.on_message(std::string_view(data.data() + sum + frame.offset, frame.length), handler);
+            sum += frame.size;
+        }
+        return sum;
+    }
+};
@@ -7,5 +7,16 @@ template <typename Peer>
 concept is_tcp = std::is_same_v<Peer, Peer_tcp>;
 template <typename Peer>
 concept is_tls = std::is_same_v<Peer, Peer_tls>;
+// on_data() consumes a prefix of the received bytes and queues responses on the handler
+// the bytes it leaves are handed over again with whatever arrives next
+template <typename Protocol>
+concept is_protocol = std::default_initializable<Protocol> &&
+                      requires(Protocol protocol, std::span<const char> data, Handler &handler) {{ protocol.on_data(data, handler) } -> std::convertible_to<size_t>; };
+// on_views() gets the lent receive buffers in place and returns how many leading ones it is done with
+// the views it leaves are handed over again with the next ones, a response may point into them
+// with Handler::appendResponseView(), they go back once it is out
+template <typename Protocol>
+concept is_view_protocol = is_protocol<Protocol> &&
+                           requires(Protocol protocol, std::span<const Handler::RecvView> views, Handler &handler) {{ protocol.on_views(views, handler) } -> std::convertible_to<size_t>; };
 template <typename Obj>
 concept Resettable = requires(Obj obj) {{ obj.reset() } noexcept -> std::same_as<void>; };
\ No newline at end of file
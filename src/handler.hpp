@@ -1,26 +1,416 @@
 #pragma once
 
+#include <sys/uio.h>
 #include <string>
+#include <string_view>
+#include <span>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <memory_resource>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
 #include <iostream>
 
+// bytes held by connection buffers, receive chunks and arena slabs, charged as they are taken
+// a loop's budget also charges the process one, a limit of 0 is none
+// soft reached: reads from the heaviest connections pause until it drains
+// hard reached: accepts are refused and the heaviest connections closed
+class Budget
+{
+    std::atomic<long> used_ = 0;
+    size_t soft_ = 0;
+    size_t hard_ = 0;
+    Budget *parent_ = nullptr;
+
+public:
+    explicit Budget(Budget *parent = nullptr) noexcept : parent_(parent) {}
+    Budget(const Budget &) = delete;
+    Budget &operator=(const Budget &) = delete;
+    // the parent of every loop's budget, limit it before any loop runs
+    static Budget &process() noexcept
+    {
+        static Budget budget;
+        return budget;
+    }
+    inline void limit(size_t soft, size_t hard) noexcept
+    {
+        soft_ = soft;
+        hard_ = hard;
+    }
+    inline void charge(long bytes) noexcept
+    {
+        used_.fetch_add(bytes, std::memory_order_relaxed);
+        if (parent_ != nullptr)
+            parent_->charge(bytes);
+    }
+    inline size_t used() const noexcept { return static_cast<size_t>(std::max(used_.load(std::memory_order_relaxed), 0L)); }
+    inline bool isSoft() const noexcept { return (soft_ > 0 && used() >= soft_) || (parent_ != nullptr && parent_->isSoft()); }
+    inline bool isHard() const noexcept { return (hard_ > 0 && used() >= hard_) || (parent_ != nullptr && parent_->isHard()); }
+};
+
+// the slabs behind every Arena created on one loop thread, used by that thread only
+// an arena working elsewhere, a handshake thread answering 0-RTT data, takes the heap instead
+// only the small slabs every connection starts with are pooled, larger ones go back to the heap
+class Upstream : public std::pmr::memory_resource
+{
+    std::pmr::unsynchronized_pool_resource pool_{std::pmr::pool_options{0, 4 * 1024}};
+    void *do_allocate(size_t bytes, size_t align) override { return pool_.allocate(bytes, align); }
+    void do_deallocate(void *p, size_t bytes, size_t align) override { pool_.deallocate(p, bytes, align); }
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+public:
+    // the calling thread's, kept alive by the arenas that outlive the thread
+    static std::shared_ptr<Upstream> local()
+    {
+        thread_local std::shared_ptr<Upstream> upstream = std::make_shared<Upstream>();
+        return upstream;
+    }
+    static Upstream *current()
+    {
+        thread_local Upstream *upstream = local().get();
+        return upstream;
+    }
+};
+// pointer-bump allocation over slabs from the Upstream, nothing is freed before release()
+// blocks above largeBlock are taken one by one and go back on deallocate
+// off its home thread the blocks come from the heap and nothing is released
+class Arena : public std::pmr::memory_resource
+{
+    // heads every slab and large block
+    struct alignas(std::max_align_t) Slab
+    {
+        Slab *next;
+        size_t size;
+        bool isHeap;
+    };
+    std::shared_ptr<Upstream> upstream_ = Upstream::local();
+    // newest first, the oldest one survives release() unless it grew past firstSlab
+    Slab *slabs_ = nullptr;
+    char *cur_ = nullptr;
+    char *end_ = nullptr;
+    size_t used_ = 0;
+    size_t nextSize_ = firstSlab;
+    // slab and large block bytes held, charged to budget_
+    size_t capacity_ = 0;
+    Budget *budget_ = nullptr;
+    Slab *newSlab(size_t size)
+    {
+        bool isHeap = !isHome();
+        void *p = isHeap ? ::operator new(size) : upstream_->allocate(size, alignof(std::max_align_t));
+        Slab *slab = static_cast<Slab *>(p);
+        slab->next = nullptr;
+        slab->size = size;
+        slab->isHeap = isHeap;
+        capacity_ += size;
+        if (budget_ != nullptr)
+            budget_->charge(static_cast<long>(size));
+        return slab;
+    }
+    void freeSlab(Slab *slab) noexcept
+    {
+        capacity_ -= slab->size;
+        if (budget_ != nullptr)
+            budget_->charge(-static_cast<long>(slab->size));
+        if (slab->isHeap)
+            ::operator delete(slab);
+        else
+            upstream_->deallocate(slab, slab->size, alignof(std::max_align_t));
+    }
+    static bool isLarge(size_t bytes, size_t align) noexcept { return bytes > largeBlock && align <= alignof(std::max_align_t); }
+    void *do_allocate(size_t bytes, size_t align) override
+    {
+        if (isLarge(bytes, align))
+            return newSlab(sizeof(Slab) + bytes) + 1;
+        auto alignUp = [align](char *p)
+        { return reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(p) + align - 1) & ~(align - 1)); };
+        char *p = cur_ != nullptr ? alignUp(cur_) : nullptr;
+        if (p == nullptr || p + bytes > end_)
+        {
+            size_t size = std::max(nextSize_, sizeof(Slab) + bytes + align);
+            Slab *slab = newSlab(size);
+            slab->next = slabs_;
+            slabs_ = slab;
+            cur_ = reinterpret_cast<char *>(slab + 1);
+            end_ = reinterpret_cast<char *>(slab) + size;
+            nextSize_ = std::min(nextSize_ * 2, maxSlab);
+            p = alignUp(cur_);
+        }
+        cur_ = p + bytes;
+        used_ += bytes;
+        return p;
+    }
+    void do_deallocate(void *p, size_t bytes, size_t align) override
+    {
+        if (isLarge(bytes, align))
+            freeSlab(static_cast<Slab *>(p) - 1);
+    }
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+public:
+    // one receive chunk, response segments up to it stay on the slabs
+    static constexpr size_t largeBlock = 16 * 1024;
+    static constexpr size_t firstSlab = 2048;
+    static constexpr size_t maxSlab = 64 * 1024;
+    Arena() = default;
+    ~Arena() noexcept
+    {
+        release();
+        if (slabs_ != nullptr)
+            freeSlab(slabs_);
+    }
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    // the thread it was created on, the only one its Upstream serves
+    inline bool isHome() const noexcept { return Upstream::current() == upstream_.get(); }
+    // slab bytes handed out since the last release()
+    inline size_t used() const noexcept { return used_; }
+    inline size_t capacity() const noexcept { return capacity_; }
+    // the slabs held now and later are charged to budget instead
+    inline void chargeTo(Budget *budget) noexcept
+    {
+        if (budget_ != nullptr)
+            budget_->charge(-static_cast<long>(capacity_));
+        budget_ = budget;
+        if (budget_ != nullptr)
+            budget_->charge(static_cast<long>(capacity_));
+    }
+    // every slab but a small oldest one goes back, everything allocated from them is gone
+    // large blocks still belong to whoever holds them
+    void release() noexcept
+    {
+        while (slabs_ != nullptr && (slabs_->next != nullptr || slabs_->size > firstSlab))
+        {
+            Slab *slab = slabs_;
+            slabs_ = slab->next;
+            freeSlab(slab);
+        }
+        cur_ = slabs_ != nullptr ? reinterpret_cast<char *>(slabs_ + 1) : nullptr;
+        end_ = slabs_ != nullptr ? reinterpret_cast<char *>(slabs_) + slabs_->size : nullptr;
+        used_ = 0;
+        nextSize_ = firstSlab;
+    }
+};
+
 class Handler
 {
-    std::string recvBuffer_;
-    std::string sendBuffer_;
+public:
+    // a kernel-filled provided buffer lent by the transport, read-only
+    struct RecvView
+    {
+        std::string_view data;
+        int group = 0;
+        unsigned short bid = 0;
+    };
+
+    // receive chunk size, one full TLS record
+    static constexpr size_t recvChunkSize = 16384;
+    // drained receive chunks the calling thread keeps for reuse, the excess is freed now
+    static void recvSlabCapacity(size_t count) noexcept
+    {
+        RecvSlab &slab = recvSlab();
+        slab.capacity = count;
+        while (slab.chunks.size() > count)
+        {
+            delete[] slab.chunks.back();
+            slab.chunks.pop_back();
+        }
+    }
+
+private:
+    // received bytes in a chain of fixed-size chunks, read straight into the tail
+    // and consumed from the head, every chunk but the last is full
+    struct RecvChunk
+    {
+        char *data = nullptr;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+    // drained chunks go back to a per-thread slab instead of the heap
+    struct RecvSlab
+    {
+        size_t capacity = 256;
+        std::vector<char *> chunks;
+        ~RecvSlab()
+        {
+            for (char *chunk : chunks)
+                delete[] chunk;
+        }
+    };
+    static RecvSlab &recvSlab()
+    {
+        thread_local RecvSlab slab;
+        return slab;
+    }
+    char *newRecvChunk()
+    {
+        if (budget_ != nullptr)
+            budget_->charge(recvChunkSize);
+        RecvSlab &slab = recvSlab();
+        if (slab.chunks.empty())
+            return new char[recvChunkSize];
+        char *chunk = slab.chunks.back();
+        slab.chunks.pop_back();
+        return chunk;
+    }
+    void freeRecvChunk(char *chunk) noexcept
+    {
+        if (budget_ != nullptr)
+            budget_->charge(-static_cast<long>(recvChunkSize));
+        RecvSlab &slab = recvSlab();
+        if (slab.chunks.size() < slab.capacity)
+            slab.chunks.push_back(chunk);
+        else
+            delete[] chunk;
+    }
+    // receive chunks and arena slabs are charged here, it stays with the object on copy, move and swap
+    Budget *budget_ = nullptr;
+    // backs the containers below and protocol scratch, rewound whenever the connection goes idle
+    Arena arena_;
+    // slab bytes a busy connection may strand in arena_ before process() moves it to a rewound one
+    static constexpr size_t arenaCompact = 4 * Arena::maxSlab;
+    std::pmr::deque<RecvChunk> recvChunks_{&arena_};
+    size_t recvSize_ = 0;
+    // first chunk handed out by the last recvSpace()
+    size_t spaceIndex_ = 0;
+    // a copy of the leading received bytes while a protocol waits on a message across chunks
+    std::pmr::string joined_{&arena_};
+    // leading received bytes that arrived as TLS 1.3 early data
+    size_t earlyLength_ = 0;
+    // bytes the protocol still misses, and the SO_RCVLOWAT the socket has
+    size_t recvWant_ = 0;
+    int recvLowat_ = 1;
+    // where a protocol got to in the received bytes, and a value it keeps with it
+    // moves back as bytes are consumed, gone once they pass it
+    size_t markOffset_ = 0;
+    size_t markValue_ = 0;
+    // the transport closes the connection once the queued responses are out
+    bool isClosing_ = false;
+    // one queued response segment, a borrowed one points at memory its owner keeps alive until sent
+    struct SendSegment
+    {
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+        std::pmr::string owned;
+        std::string_view borrowed;
+        bool isBorrowed = false;
+        explicit SendSegment(const allocator_type &alloc = {}) : owned(alloc) {}
+        SendSegment(std::string_view data, bool isBorrowed, const allocator_type &alloc = {})
+            : owned(isBorrowed ? std::string_view() : data, alloc), borrowed(isBorrowed ? data : std::string_view()), isBorrowed(isBorrowed) {}
+        SendSegment(const SendSegment &other, const allocator_type &alloc = {})
+            : owned(other.owned, alloc), borrowed(other.borrowed), isBorrowed(other.isBorrowed) {}
+        SendSegment(SendSegment &&other, const allocator_type &alloc)
+            : owned(std::move(other.owned), alloc), borrowed(other.borrowed), isBorrowed(other.isBorrowed) {}
+        SendSegment(SendSegment &&other) noexcept = default;
+        SendSegment &operator=(const SendSegment &other) = default;
+        SendSegment &operator=(SendSegment &&other) noexcept = default;
+        inline std::string_view data() const noexcept { return isBorrowed ? borrowed : std::string_view(owned); }
+    };
+    // responses go out in order, sent segments are dropped unless pinned
+    std::pmr::deque<SendSegment> sendQueue_{&arena_};
+    // the segment and offset the next send starts at
+    size_t sendIndex_ = 0;
     size_t sendOffset_ = 0;
     bool isSending_ = false;
+    int refs_ = 0;
+    std::pmr::vector<RecvView> recvViews_{&arena_};
+    // prefix of recvViews_ the transport may take back
+    size_t releasedViews_ = 0;
+    // a registered send buffer lent by the transport for the connection lifetime
+    // isFixed_ the current response lives there instead of sendQueue_
+    char *fixedBuf_ = nullptr;
+    size_t fixedCapa_ = 0;
+    size_t fixedLen_ = 0;
+    int fixedIndex_ = -1;
+    bool isFixed_ = false;
+    // a file region sent after the buffered response, the fd stays the caller's
+    int fileFd_ = -1;
+    off_t fileOffset_ = 0;
+    size_t fileLength_ = 0;
+    inline void spillFixed()
+    {
+        if (fixedLen_ > 0)
+            sendQueue_.emplace_back(std::string_view(fixedBuf_, fixedLen_), false);
+        isFixed_ = false;
+    }
+    inline void freeRecvChunks() noexcept
+    {
+        for (const RecvChunk &chunk : recvChunks_)
+            freeRecvChunk(chunk.data);
+        recvChunks_.clear();
+    }
+    // the containers start over on a released arena, they must hold nothing the connection still needs
+    inline void rewind() noexcept
+    {
+        std::destroy_at(&recvChunks_);
+        std::destroy_at(&joined_);
+        std::destroy_at(&sendQueue_);
+        std::destroy_at(&recvViews_);
+        arena_.release();
+        std::construct_at(&recvChunks_, &arena_);
+        std::construct_at(&joined_, &arena_);
+        std::construct_at(&sendQueue_, &arena_);
+        std::construct_at(&recvViews_, &arena_);
+    }
+    // an idle connection that outgrew the first slab gives the rest back
+    // slabs only go back on the arena's home thread
+    inline void rewindIdle() noexcept
+    {
+        if (arena_.isHome() && arena_.used() > Arena::firstSlab && recvChunks_.empty() && joined_.empty() &&
+            sendQueue_.empty() && recvViews_.empty() && !isSending_ && !isPinned())
+            rewind();
+    }
+    // chunks that changed hands are charged to the budget of the handler now holding them
+    static void recharge(Handler &from, Handler &to, long chunks) noexcept
+    {
+        if (from.budget_ != nullptr)
+            from.budget_->charge(-chunks * static_cast<long>(recvChunkSize));
+        if (to.budget_ != nullptr)
+            to.budget_->charge(chunks * static_cast<long>(recvChunkSize));
+    }
+    // pmr containers on different arenas can't be swapped, their elements move instead
+    template <typename Container>
+    static void swapAcross(Container &a, Container &b)
+    {
+        Container tmp(std::move(a));
+        a = std::move(b);
+        b = std::move(tmp);
+    }
 
 public:
-    Handler() noexcept = default;
-    ~Handler() noexcept { reset(); }
+    Handler() = default;
+    ~Handler() noexcept { freeRecvChunks(); }
     Handler(const Handler &other)
     {
         if (this != &other)
         {
-            recvBuffer_ = other.recvBuffer_;
-            sendBuffer_ = other.sendBuffer_;
+            for (const RecvChunk &chunk : other.recvChunks_)
+            {
+                recvChunks_.push_back({newRecvChunk(), chunk.begin, chunk.end});
+                std::memcpy(recvChunks_.back().data + chunk.begin, chunk.data + chunk.begin, chunk.end - chunk.begin);
+            }
+            recvSize_ = other.recvSize_;
+            joined_ = other.joined_;
+            earlyLength_ = other.earlyLength_;
+            recvWant_ = other.recvWant_;
+            recvLowat_ = other.recvLowat_;
+            markOffset_ = other.markOffset_;
+            markValue_ = other.markValue_;
+            isClosing_ = other.isClosing_;
+            sendQueue_ = other.sendQueue_;
+            sendIndex_ = other.sendIndex_;
             sendOffset_ = other.sendOffset_;
             isSending_ = other.isSending_;
+            refs_ = other.refs_;
+            recvViews_ = other.recvViews_;
+            releasedViews_ = other.releasedViews_;
+            fileFd_ = other.fileFd_;
+            fileOffset_ = other.fileOffset_;
+            fileLength_ = other.fileLength_;
+            // the lent buffer stays with other
+            if (other.isFixed_ && other.fixedLen_ > 0)
+                sendQueue_.emplace_back(std::string_view(other.fixedBuf_, other.fixedLen_), false);
         }
     }
     Handler &operator=(const Handler &other)
@@ -29,84 +419,633 @@ public:
             Handler(other).swap(*this);
         return *this;
     }
-    Handler(Handler &&other) noexcept
+    // containers on different arenas can't hand their storage over, the elements are moved
+    Handler(Handler &&other)
     {
         if (this != &other)
         {
-            recvBuffer_ = std::move(other.recvBuffer_);
-            sendBuffer_ = std::move(other.sendBuffer_);
+            recvChunks_ = std::move(other.recvChunks_);
+            other.recvChunks_.clear();
+            recharge(other, *this, static_cast<long>(recvChunks_.size()));
+            recvSize_ = other.recvSize_;
+            other.recvSize_ = 0;
+            joined_ = std::move(other.joined_);
+            other.joined_.clear();
+            recvWant_ = other.recvWant_;
+            other.recvWant_ = 0;
+            recvLowat_ = other.recvLowat_;
+            other.recvLowat_ = 1;
+            markOffset_ = other.markOffset_;
+            other.markOffset_ = 0;
+            markValue_ = other.markValue_;
+            other.markValue_ = 0;
+            isClosing_ = other.isClosing_;
+            other.isClosing_ = false;
+            earlyLength_ = other.earlyLength_;
+            other.earlyLength_ = 0;
+            sendQueue_ = std::move(other.sendQueue_);
+            other.sendQueue_.clear();
+            sendIndex_ = other.sendIndex_;
+            other.sendIndex_ = 0;
             sendOffset_ = other.sendOffset_;
             other.sendOffset_ = 0;
             isSending_ = other.isSending_;
             other.isSending_ = false;
+            refs_ = other.refs_;
+            other.refs_ = 0;
+            recvViews_ = std::move(other.recvViews_);
+            other.recvViews_.clear();
+            releasedViews_ = other.releasedViews_;
+            other.releasedViews_ = 0;
+            fixedBuf_ = other.fixedBuf_;
+            other.fixedBuf_ = nullptr;
+            fixedCapa_ = other.fixedCapa_;
+            other.fixedCapa_ = 0;
+            fixedLen_ = other.fixedLen_;
+            other.fixedLen_ = 0;
+            fixedIndex_ = other.fixedIndex_;
+            other.fixedIndex_ = -1;
+            isFixed_ = other.isFixed_;
+            other.isFixed_ = false;
+            fileFd_ = other.fileFd_;
+            other.fileFd_ = -1;
+            fileOffset_ = other.fileOffset_;
+            other.fileOffset_ = 0;
+            fileLength_ = other.fileLength_;
+            other.fileLength_ = 0;
         }
     }
-    Handler &operator=(Handler &&other) noexcept
+    Handler &operator=(Handler &&other)
     {
         if (&other != this)
             Handler(std::move(other)).swap(*this);
         return *this;
     }
+    // a released handler is no longer charged
     inline void reset() noexcept
     {
-        recvBuffer_.clear();
-        sendBuffer_.clear();
+        freeRecvChunks();
+        rewind();
+        chargeTo(nullptr);
+        recvSize_ = 0;
+        spaceIndex_ = 0;
+        recvWant_ = 0;
+        recvLowat_ = 1;
+        markOffset_ = 0;
+        markValue_ = 0;
+        isClosing_ = false;
+        earlyLength_ = 0;
+        sendIndex_ = 0;
         sendOffset_ = 0;
         isSending_ = false;
+        refs_ = 0;
+        releasedViews_ = 0;
+        fixedBuf_ = nullptr;
+        fixedCapa_ = 0;
+        fixedLen_ = 0;
+        fixedIndex_ = -1;
+        isFixed_ = false;
+        fileFd_ = -1;
+        fileOffset_ = 0;
+        fileLength_ = 0;
     }
-    inline void swap(Handler &other) noexcept
+    inline void swap(Handler &other)
     {
-        std::swap(recvBuffer_, other.recvBuffer_);
-        std::swap(sendBuffer_, other.sendBuffer_);
+        recharge(other, *this, static_cast<long>(other.recvChunks_.size()) - static_cast<long>(recvChunks_.size()));
+        swapAcross(recvChunks_, other.recvChunks_);
+        std::swap(recvSize_, other.recvSize_);
+        std::swap(spaceIndex_, other.spaceIndex_);
+        swapAcross(joined_, other.joined_);
+        std::swap(recvWant_, other.recvWant_);
+        std::swap(recvLowat_, other.recvLowat_);
+        std::swap(markOffset_, other.markOffset_);
+        std::swap(markValue_, other.markValue_);
+        std::swap(isClosing_, other.isClosing_);
+        std::swap(earlyLength_, other.earlyLength_);
+        swapAcross(sendQueue_, other.sendQueue_);
+        std::swap(sendIndex_, other.sendIndex_);
         std::swap(sendOffset_, other.sendOffset_);
         std::swap(isSending_, other.isSending_);
+        std::swap(refs_, other.refs_);
+        swapAcross(recvViews_, other.recvViews_);
+        std::swap(releasedViews_, other.releasedViews_);
+        std::swap(fixedBuf_, other.fixedBuf_);
+        std::swap(fixedCapa_, other.fixedCapa_);
+        std::swap(fixedLen_, other.fixedLen_);
+        std::swap(fixedIndex_, other.fixedIndex_);
+        std::swap(isFixed_, other.isFixed_);
+        std::swap(fileFd_, other.fileFd_);
+        std::swap(fileOffset_, other.fileOffset_);
+        std::swap(fileLength_, other.fileLength_);
     }
-    inline void appendRecvStream(const char *buf, size_t n) { recvBuffer_.append(buf, n); }
-    inline const char *responseBegin() const noexcept { return sendBuffer_.data() + sendOffset_; }
-    inline size_t responseLength() const noexcept { return sendBuffer_.size() - sendOffset_; }
-    inline bool isResponse() noexcept
+    // writable tail of the receive chain covering len bytes in at most count iovecs
+    // n the iovecs, 0 count == 0 || len == 0
+    inline size_t recvSpace(iovec *iov, size_t count, size_t len)
     {
-        if (isSending_)
+        if (count == 0 || len == 0)
+            return 0;
+        if (recvChunks_.empty() || recvChunks_.back().end == recvChunkSize)
+            recvChunks_.push_back({newRecvChunk(), 0, 0});
+        spaceIndex_ = recvChunks_.size() - 1;
+        size_t n = 0;
+        while (true)
+        {
+            RecvChunk &chunk = recvChunks_.back();
+            size_t room = std::min(recvChunkSize - chunk.end, len);
+            iov[n].iov_base = chunk.data + chunk.end;
+            iov[n].iov_len = room;
+            ++n;
+            len -= room;
+            if (len == 0 || n == count)
+                break;
+            recvChunks_.push_back({newRecvChunk(), 0, 0});
+        }
+        return n;
+    }
+    // n bytes were written into the last recvSpace(), unused chunks go back
+    // every recvSpace() is paired with one, n may be 0
+    // 0-RTT data may be a replay, only idempotent requests should act on it
+    inline void recvCommit(size_t n, bool isEarly = false) noexcept
+    {
+        recvSize_ += n;
+        if (isEarly)
+            earlyLength_ += n;
+        for (size_t i = spaceIndex_; i < recvChunks_.size() && n > 0; ++i)
+        {
+            size_t room = std::min(recvChunkSize - recvChunks_[i].end, n);
+            recvChunks_[i].end += room;
+            n -= room;
+        }
+        while (!recvChunks_.empty() && recvChunks_.back().end == recvChunks_.back().begin)
+        {
+            freeRecvChunk(recvChunks_.back().data);
+            recvChunks_.pop_back();
+        }
+    }
+    inline void appendRecvStream(const char *buf, size_t n)
+    {
+        iovec iov[8];
+        while (n > 0)
+        {
+            size_t len = std::min(n, sizeof(iov) / sizeof(iov[0]) * recvChunkSize);
+            size_t count = recvSpace(iov, sizeof(iov) / sizeof(iov[0]), len);
+            size_t sum = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                std::memcpy(iov[i].iov_base, buf + sum, iov[i].iov_len);
+                sum += iov[i].iov_len;
+            }
+            recvCommit(sum);
+            buf += sum;
+            n -= sum;
+        }
+    }
+    // received bytes not consumed yet
+    inline size_t recvSize() const noexcept { return recvSize_; }
+    // readable bytes of the receive chain in at most count iovecs
+    inline size_t recvData(iovec *iov, size_t count) const noexcept
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < recvChunks_.size() && n < count; ++i)
+        {
+            const RecvChunk &chunk = recvChunks_[i];
+            if (chunk.end == chunk.begin)
+                continue;
+            iov[n].iov_base = chunk.data + chunk.begin;
+            iov[n].iov_len = chunk.end - chunk.begin;
+            ++n;
+        }
+        return n;
+    }
+    // the protocol layer is done with the first n received bytes, drained chunks go back
+    inline void consumeRecv(size_t n) noexcept
+    {
+        n = std::min(n, recvSize_);
+        recvSize_ -= n;
+        joined_.erase(0, std::min(n, joined_.size()));
+        earlyLength_ -= std::min(n, earlyLength_);
+        if (markOffset_ > n)
+            markOffset_ -= n;
+        else
+            markOffset_ = markValue_ = 0;
+        while (n > 0)
+        {
+            RecvChunk &chunk = recvChunks_.front();
+            size_t len = std::min(chunk.end - chunk.begin, n);
+            chunk.begin += len;
+            n -= len;
+            if (chunk.begin == chunk.end)
+            {
+                freeRecvChunk(chunk.data);
+                recvChunks_.pop_front();
+            }
+        }
+    }
+    inline size_t earlyLength() const noexcept { return earlyLength_; }
+    // per-connection scratch for protocol state, freed as a whole
+    // what is allocated is gone once the handler goes idle, see rewindIdle(), is reclaimed or reset
+    // blocks above Arena::largeBlock must be deallocated before then
+    inline std::pmr::memory_resource *arena() noexcept { return &arena_; }
+    // arena bytes in use since it was last rewound
+    inline size_t arenaUsed() const noexcept { return arena_.used(); }
+    // buffers are charged to budget from now on, along with what the handler already holds
+    inline void chargeTo(Budget *budget) noexcept
+    {
+        long held = static_cast<long>(recvChunks_.size() * recvChunkSize);
+        if (budget_ != nullptr)
+            budget_->charge(-held);
+        budget_ = budget;
+        if (budget_ != nullptr)
+            budget_->charge(held);
+        arena_.chargeTo(budget);
+    }
+    // bytes of receive chunks, arena slabs and large blocks held
+    inline size_t charged() const noexcept { return recvChunks_.size() * recvChunkSize + arena_.capacity(); }
+    // a connection gone quiet gives back what it holds beyond its live bytes
+    // joined_ is dropped, process() builds it again, pending bytes are packed into
+    // as few chunks as they need and the containers move onto a rewound arena
+    // a response still going out is left alone, SSL_write() retries need the same buffer
+    // true something was given back
+    inline bool reclaim()
+    {
+        if (isSending_ || isPinned() || !arena_.isHome())
             return false;
+        bool isPacked = recvChunks_.size() > (recvSize_ + recvChunkSize - 1) / recvChunkSize;
+        if (!isPacked && joined_.empty() && arena_.used() <= Arena::firstSlab)
+            return false;
+        std::vector<RecvChunk> chunks;
+        if (isPacked)
+        {
+            for (const RecvChunk &chunk : recvChunks_)
+            {
+                for (size_t off = chunk.begin; off < chunk.end;)
+                {
+                    if (chunks.empty() || chunks.back().end == recvChunkSize)
+                        chunks.push_back({newRecvChunk(), 0, 0});
+                    RecvChunk &to = chunks.back();
+                    size_t len = std::min(chunk.end - off, recvChunkSize - to.end);
+                    std::memcpy(to.data + to.end, chunk.data + off, len);
+                    to.end += len;
+                    off += len;
+                }
+                freeRecvChunk(chunk.data);
+            }
+        }
+        else
+            chunks.assign(recvChunks_.begin(), recvChunks_.end());
+        std::vector<SendSegment> segments(sendQueue_.begin(), sendQueue_.end());
+        std::vector<RecvView> views(recvViews_.begin(), recvViews_.end());
+        rewind();
+        recvChunks_.assign(chunks.begin(), chunks.end());
+        sendQueue_.assign(segments.begin(), segments.end());
+        recvViews_.assign(views.begin(), views.end());
+        return true;
+    }
+    // nothing more is read, the connection closes after the queued responses
+    inline void closeAfterResponse() noexcept { isClosing_ = true; }
+    inline bool isClosing() const noexcept { return isClosing_; }
+    // true closing and every response is out
+    inline bool isClosed() const noexcept { return isClosing_ && !isSending_ && fileLength_ == 0; }
+    // a protocol waits on n more bytes, 0 unknown
+    inline void expectRecv(size_t n) noexcept { recvWant_ = n; }
+    // a protocol scanned the received bytes up to offset and needn't again, 0 none
+    inline void mark(size_t offset, size_t value = 0) noexcept
+    {
+        markOffset_ = offset;
+        markValue_ = offset > 0 ? value : 0;
+    }
+    inline size_t markOffset() const noexcept { return markOffset_; }
+    inline size_t markValue() const noexcept { return markValue_; }
+    // a message is partly received, only reading the rest frees what it holds
+    inline bool isAwaitingRecv() const noexcept { return recvSize_ > 0 || recvWant_ > 0; }
+    // true the socket should get SO_RCVLOWAT lowat, so epoll wakes once a pending
+    // frame can complete rather than per segment, capped below the receive buffer
+    inline bool updateRecvLowat(int &lowat) noexcept
+    {
+        int want = static_cast<int>(std::clamp<size_t>(recvWant_, 1, 64 * 1024));
+        if (want == recvLowat_)
+            return false;
+        lowat = recvLowat_ = want;
+        return true;
+    }
+    inline void lendRecvView(const RecvView &view) { recvViews_.push_back(view); }
+    inline const std::pmr::vector<RecvView> &recvViews() const noexcept { return recvViews_; }
+    inline size_t releasedViews() const noexcept { return releasedViews_; }
+    // the next count views are no longer read
+    inline void releaseRecvViews(size_t count) noexcept { releasedViews_ = std::min(releasedViews_ + count, recvViews_.size()); }
+    // all true: the connection is going away, every view goes back
+    template <typename GiveBack>
+    inline void reclaimRecvViews(GiveBack &&giveBack, bool all = false)
+    {
+        size_t count = all ? recvViews_.size() : releasedViews_;
+        for (size_t i = 0; i < count; ++i)
+            giveBack(recvViews_[i]);
+        recvViews_.erase(recvViews_.begin(), recvViews_.begin() + count);
+        releasedViews_ = 0;
+    }
+    inline void lendSendBuffer(char *buf, size_t capa, int index) noexcept
+    {
+        fixedBuf_ = buf;
+        fixedCapa_ = capa;
+        fixedLen_ = 0;
+        fixedIndex_ = index;
+        isFixed_ = false;
+    }
+    // the lent buffer index, -1 none
+    inline int sendBufferIndex() const noexcept { return fixedIndex_; }
+    // the lent buffer index if the current response lives there, -1 otherwise
+    inline int responseIndex() const noexcept { return isFixed_ ? fixedIndex_ : -1; }
+    // responses are written into the lent buffer while they fit, then spill to sendQueue_
+    // a response still going out is kept, what is appended next queues behind it
+    inline void clearResponse() noexcept
+    {
+        if (isSending_)
+            return;
+        sendQueue_.clear();
+        sendIndex_ = 0;
         sendOffset_ = 0;
-        isSending_ = false;
-        if (sendOffset_ < sendBuffer_.size())
-            isSending_ = true;
+        fixedLen_ = 0;
+        isFixed_ = fixedBuf_ != nullptr;
+        fileFd_ = -1;
+        fileOffset_ = 0;
+        fileLength_ = 0;
+    }
+    inline void appendResponse(std::string_view data)
+    {
+        if (data.empty())
+            return;
+        if (isFixed_ && fixedLen_ + data.size() > fixedCapa_)
+            spillFixed();
+        if (isFixed_)
+        {
+            std::memcpy(fixedBuf_ + fixedLen_, data.data(), data.size());
+            fixedLen_ += data.size();
+            return;
+        }
+        // never grow a sent segment, a borrowed one or one the kernel may be reading
+        if (sendQueue_.size() <= sendIndex_ || sendQueue_.back().isBorrowed ||
+            (isPinned() && sendQueue_.size() == sendIndex_ + 1))
+            sendQueue_.emplace_back();
+        sendQueue_.back().owned.append(data);
+    }
+    // data is sent in place, it must stay alive until stillSending() moves past it
+    inline void appendResponseView(std::string_view data)
+    {
+        if (data.empty())
+            return;
+        if (isFixed_)
+            spillFixed();
+        sendQueue_.emplace_back(data, true);
+    }
+    inline void appendResponseFile(int fd, off_t offset, size_t len) noexcept
+    {
+        fileFd_ = fd;
+        fileOffset_ = offset;
+        fileLength_ = len;
+    }
+    inline int responseFile() const noexcept { return fileFd_; }
+    inline off_t responseFileOffset() const noexcept { return fileOffset_; }
+    inline size_t responseFileLength() const noexcept { return fileLength_; }
+    // the buffered part is out, the file region is not
+    inline bool isSendingFile() const noexcept { return !isSending_ && fileLength_ > 0; }
+    inline bool stillSendingFile(ssize_t sn) noexcept
+    {
+        if (sn <= 0 || static_cast<size_t>(sn) >= fileLength_)
+        {
+            if (sn > 0)
+            {
+                fileFd_ = -1;
+                fileOffset_ = 0;
+                fileLength_ = 0;
+            }
+            return false;
+        }
+        fileOffset_ += sn;
+        fileLength_ -= sn;
         return true;
     }
+    // the unsent part of the current segment
+    inline const char *responseBegin() const noexcept
+    {
+        if (isFixed_)
+            return fixedBuf_ + sendOffset_;
+        return sendIndex_ < sendQueue_.size() ? sendQueue_[sendIndex_].data().data() + sendOffset_ : nullptr;
+    }
+    inline size_t responseLength() const noexcept
+    {
+        if (isFixed_)
+            return fixedLen_ - sendOffset_;
+        return sendIndex_ < sendQueue_.size() ? sendQueue_[sendIndex_].data().size() - sendOffset_ : 0;
+    }
+    // the unsent segments in at most count iovecs for writev() or sendmsg()
+    inline size_t responseIov(iovec *iov, size_t count) const noexcept
+    {
+        if (count == 0 || responseLength() == 0)
+            return 0;
+        iov[0].iov_base = const_cast<char *>(responseBegin());
+        iov[0].iov_len = responseLength();
+        size_t n = 1;
+        for (size_t i = sendIndex_ + 1; !isFixed_ && i < sendQueue_.size() && n < count; ++i, ++n)
+        {
+            iov[n].iov_base = const_cast<char *>(sendQueue_[i].data().data());
+            iov[n].iov_len = sendQueue_[i].data().size();
+        }
+        return n;
+    }
+    // io_uring operations in flight on this connection, the owning recv counts as one
+    // pinned: the kernel may still read sendQueue_, e.g. until a zero-copy notification
+    inline void ref() noexcept { ++refs_; }
+    inline int unref() noexcept { return --refs_; }
+    inline bool isPinned() const noexcept { return refs_ > 1; }
+    // true a new response starts going out
+    // false nothing to send, or one is already going out and the new segments follow it
+    inline bool isResponse() noexcept
+    {
+        if (isSending_ || isPinned())
+            return false;
+        isSending_ = responseLength() > 0;
+        return isSending_ || fileLength_ > 0;
+    }
+    inline bool isSending() const noexcept { return isSending_; }
+    // sn may span several segments
     inline bool stillSending(ssize_t sn) noexcept
     {
         if (sn < 0)
             sn = 0;
         if (!isSending_)
-        {
-            sendOffset_ = 0;
-            isSending_ = false;
             return false;
+        size_t left = sn;
+        if (isFixed_)
+        {
+            sendOffset_ = std::min(sendOffset_ + left, fixedLen_);
+            if (sendOffset_ < fixedLen_)
+                return true;
         }
-        sendOffset_ += sn;
-        if (sendOffset_ >= sendBuffer_.size())
+        else
         {
-            sendOffset_ = 0;
-            isSending_ = false;
-            return false;
+            while (sendIndex_ < sendQueue_.size())
+            {
+                size_t room = sendQueue_[sendIndex_].data().size() - sendOffset_;
+                if (left < room)
+                {
+                    sendOffset_ += left;
+                    break;
+                }
+                left -= room;
+                ++sendIndex_;
+                sendOffset_ = 0;
+            }
+            if (!isPinned())
+            {
+                sendQueue_.erase(sendQueue_.begin(), sendQueue_.begin() + sendIndex_);
+                sendIndex_ = 0;
+            }
+            if (sendIndex_ < sendQueue_.size())
+                return true;
         }
-        return true;
+        isSending_ = false;
+        rewindIdle();
+        return false;
     }
 
     void process_stdin()
     {
         std::cout << "send: ";
-        std::cin >> sendBuffer_;
+        std::string line;
+        std::cin >> line;
+        clearResponse();
+        isFixed_ = false;
+        appendResponse(line);
     }
     void process_stdout()
     {
-        std::cout << "recv: " << recvBuffer_ << std::endl;
+        iovec iov[64];
+        size_t count = recvData(iov, sizeof(iov) / sizeof(iov[0]));
+        size_t sum = 0;
+        std::cout << "recv: ";
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::cout << std::string_view(static_cast<char *>(iov[i].iov_base), iov[i].iov_len);
+            sum += iov[i].iov_len;
+        }
+        std::cout << std::endl;
+        consumeRecv(sum);
     }
+    // a response still going out is followed by the new bytes, a pinned one is left alone
     void process_reflect()
     {
-        std::cout << "recv: " << recvBuffer_ << std::endl;
-        sendBuffer_ = recvBuffer_;
+        if (isPinned())
+            return;
+        clearResponse();
+        iovec iov[64];
+        size_t count = recvData(iov, sizeof(iov) / sizeof(iov[0]));
+        size_t sum = 0;
+        std::cout << "recv: ";
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::string_view data(static_cast<char *>(iov[i].iov_base), iov[i].iov_len);
+            std::cout << data;
+            appendResponse(data);
+            sum += iov[i].iov_len;
+        }
+        std::cout << std::endl;
+        consumeRecv(sum);
+    }
+    // hands the lent views not released yet to protocol.on_views() and releases what it returns
+    // waits while a response is going out, its segments may point into them
+    template <typename Protocol>
+    void process_view(Protocol &protocol)
+    {
+        if (isSending_ || isPinned() || releasedViews_ == recvViews_.size())
+            return;
+        clearResponse();
+        releaseRecvViews(protocol.on_views(std::span<const RecvView>(recvViews_).subspan(releasedViews_), *this));
+    }
+    // HTTP/1.1 with the default Http<> protocol, defined in http.hpp
+    void process_http();
+    // hands the received bytes to protocol.on_data() and consumes what it returns
+    // 0 waits for more, a message across chunks is then handed over whole, joined
+    // with the bytes after it until the protocol gets past it
+    template <typename Protocol>
+    void process(Protocol &protocol)
+    {
+        if (isPinned())
+            return;
+        if (isClosing_)
+        {
+            consumeRecv(recvSize_);
+            return;
+        }
+        clearResponse();
+        while (recvSize_ > 0)
+        {
+            std::span<const char> data;
+            if (joined_.empty())
+            {
+                const RecvChunk &chunk = recvChunks_.front();
+                data = std::span<const char>(chunk.data + chunk.begin, chunk.end - chunk.begin);
+            }
+            else
+            {
+                joinRecv();
+                data = std::span<const char>(joined_);
+            }
+            recvWant_ = 0;
+            size_t n = protocol.on_data(data, *this);
+            if (n == 0 && joined_.empty() && data.size() < recvSize_)
+            {
+                joinRecv();
+                recvWant_ = 0;
+                n = protocol.on_data(std::span<const char>(joined_), *this);
+            }
+            if (n == 0)
+                break;
+            // only the message across chunks needed the copy, what follows it is handed over in place
+            joined_.clear();
+            consumeRecv(n);
+            if (isClosing_)
+            {
+                consumeRecv(recvSize_);
+                break;
+            }
+        }
+        rewindIdle();
+        // small blocks freed while the connection never goes idle are stranded in the slabs
+        if (arena_.used() > arenaCompact)
+            reclaim();
+    }
+
+private:
+    // joined_ catches up with the received bytes, only the new ones are copied
+    void joinRecv()
+    {
+        size_t skip = joined_.size();
+        for (const RecvChunk &chunk : recvChunks_)
+        {
+            size_t len = chunk.end - chunk.begin;
+            if (skip >= len)
+            {
+                skip -= len;
+                continue;
+            }
+            joined_.append(chunk.data + chunk.begin + skip, len - skip);
+            skip = 0;
+        }
+    }
+};
+// the default protocol, every received byte goes straight back
+struct Reflect
+{
+    inline size_t on_data(std::span<const char> data, Handler &handler)
+    {
+        handler.appendResponse(std::string_view(data.data(), data.size()));
+        return data.size();
+    }
+    // the lent buffers go back out as they are
+    inline size_t on_views(std::span<const Handler::RecvView> views, Handler &handler)
+    {
+        for (const Handler::RecvView &view : views)
+            handler.appendResponseView(view.data);
+        return views.size();
     }
-    void process_http() {}
 };
@@ -0,0 +1,426 @@
+#pragma once
+
+#include <charconv>
+#include <ctime>
+#include "codec.hpp"
+
+struct HttpHeader
+{
+    std::string_view name;
+    std::string_view value;
+};
+// views into the received bytes, valid during on_request() only
+// body views the decoded copy of a chunked body
+struct HttpRequest
+{
+    static constexpr size_t maxHeaders = 64;
+    std::string_view method;
+    std::string_view target;
+    std::string_view version;
+    HttpHeader headers[maxHeaders];
+    size_t headerCount = 0;
+    std::string_view body;
+    bool isKeepAlive = true;
+    // only A-Z fold, anything else must match exactly
+    static bool iequals(std::string_view a, std::string_view b) noexcept
+    {
+        if (a.size() != b.size())
+            return false;
+        auto lower = [](char c)
+        { return c >= 'A' && c <= 'Z' ? static_cast<char>(c | 0x20) : c; };
+        for (size_t i = 0; i < a.size(); ++i)
+            if (lower(a[i]) != lower(b[i]))
+                return false;
+        return true;
+    }
+    // the first value of name, empty none
+    std::string_view header(std::string_view name) const noexcept
+    {
+        for (size_t i = 0; i < headerCount; ++i)
+            if (iequals(headers[i].name, name))
+                return headers[i].value;
+        return {};
+    }
+};
+// one response queued on the handler, in request order
+class HttpResponse
+{
+    static constexpr size_t maxHeaders = 16;
+    Handler &handler_;
+    bool isKeepAlive_ = true;
+    // an HTTP/1.0 client closes unless told the connection stays open
+    bool isHttp10_ = false;
+    // HEAD gets the headers of the response only
+    bool isHead_ = false;
+    bool isSent_ = false;
+    HttpHeader headers_[maxHeaders];
+    size_t headerCount_ = 0;
+    static std::string_view reason(int status) noexcept
+    {
+        switch (status)
+        {
+        case 200:
+            return "OK";
+        case 201:
+            return "Created";
+        case 204:
+            return "No Content";
+        case 301:
+            return "Moved Permanently";
+        case 304:
+            return "Not Modified";
+        case 400:
+            return "Bad Request";
+        case 404:
+            return "Not Found";
+        case 405:
+            return "Method Not Allowed";
+        case 413:
+            return "Content Too Large";
+        case 431:
+            return "Request Header Fields Too Large";
+        case 500:
+            return "Internal Server Error";
+        case 501:
+            return "Not Implemented";
+        case 505:
+            return "HTTP Version Not Supported";
+        default:
+            return "Unknown";
+        }
+    }
+    // formatted once a second per thread
+    static std::string_view date() noexcept
+    {
+        thread_local char buf[40]{0};
+        thread_local time_t last = 0;
+        thread_local size_t len = 0;
+        time_t now = time(nullptr);
+        if (now != last)
+        {
+            tm gmt;
+            gmtime_r(&now, &gmt);
+            len = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+            last = now;
+        }
+        return std::string_view(buf, len);
+    }
+
+public:
+    HttpResponse(Handler &handler, bool isKeepAlive) noexcept
+        : handler_(handler), isKeepAlive_(isKeepAlive) {}
+    HttpResponse(Handler &handler, const HttpRequest &request) noexcept
+        : handler_(handler), isKeepAlive_(request.isKeepAlive),
+          isHttp10_(request.version == "HTTP/1.0"), isHead_(request.method == "HEAD") {}
+    // name and value must outlive send()
+    // false too many headers
+    bool header(std::string_view name, std::string_view value) noexcept
+    {
+        if (headerCount_ == maxHeaders)
+            return false;
+        headers_[headerCount_++] = {name, value};
+        return true;
+    }
+    void send(int status, std::string_view body, std::string_view contentType = "text/plain")
+    {
+        if (isSent_)
+            return;
+        isSent_ = true;
+        char num[24];
+        auto [end, ec] = std::to_chars(num, num + sizeof(num), status);
+        handler_.appendResponse("HTTP/1.1 ");
+        handler_.appendResponse(std::string_view(num, end - num));
+        handler_.appendResponse(" ");
+        handler_.appendResponse(reason(status));
+        handler_.appendResponse("\r\nDate: ");
+        handler_.appendResponse(date());
+        if (!body.empty())
+        {
+            handler_.appendResponse("\r\nContent-Type: ");
+            handler_.appendResponse(contentType);
+        }
+        end = std::to_chars(num, num + sizeof(num), body.size()).ptr;
+        handler_.appendResponse("\r\nContent-Length: ");
+        handler_.appendResponse(std::string_view(num, end - num));
+        if (!isKeepAlive_)
+            handler_.appendResponse("\r\nConnection: close");
+        else if (isHttp10_)
+            handler_.appendResponse("\r\nConnection: keep-alive");
+        for (size_t i = 0; i < headerCount_; ++i)
+        {
+            handler_.appendResponse("\r\n");
+            handler_.appendResponse(headers_[i].name);
+            handler_.appendResponse(": ");
+            handler_.appendResponse(headers_[i].value);
+        }
+        handler_.appendResponse("\r\n\r\n");
+        if (!isHead_)
+            handler_.appendResponse(body);
+    }
+    inline bool isSent() const noexcept { return isSent_; }
+};
+template <typename App>
+concept is_http_app = std::default_initializable<App> &&
+                      requires(App app, const HttpRequest &request, HttpResponse &response) { app.on_request(request, response); };
+
+// answers every request with a fixed body, the baseline for benchmarks
+struct HelloHttp
+{
+    inline void on_request(const HttpRequest &, HttpResponse &response) { response.send(200, "Hello, World!"); }
+};
+
+// HTTP/1.1 requests in, App::on_request() per request, responses out in order
+// lines are found with Scan, the request is parsed in place without allocating
+// pipelined requests in one read are all answered before the next read
+// an App that doesn't send gets 404, a malformed request a 4xx/5xx and a close
+template <is_http_app App = HelloHttp>
+class Http
+{
+    // the decoded chunked body, reused across requests
+    std::string body_;
+
+public:
+    App app{};
+    size_t maxHead = 64 * 1024;
+    size_t maxBody = 8 * 1024 * 1024;
+    inline size_t on_data(std::span<const char> data, Handler &handler)
+    {
+        size_t sum = 0;
+        while (sum < data.size() && !handler.isClosing())
+        {
+            // empty lines between requests are ignored
+            if (data[sum] == '\r' || data[sum] == '\n')
+            {
+                ++sum;
+                continue;
+            }
+            HttpRequest request;
+            long n = parse(data.subspan(sum), sum, request, handler);
+            if (n == 0)
+                break;
+            if (n < 0)
+            {
+                HttpResponse response(handler, false);
+                response.send(static_cast<int>(-n), "");
+                handler.closeAfterResponse();
+                return data.size();
+            }
+            HttpResponse response(handler, request);
+            app.on_request(request, response);
+            if (!response.isSent())
+                response.send(404, "");
+            if (!request.isKeepAlive)
+                handler.closeAfterResponse();
+            sum += n;
+        }
+        return sum;
+    }
+
+private:
+    // n the bytes of one whole request, base bytes into the received ones
+    // 0 incomplete
+    // -status malformed
+    long parse(std::span<const char> data, size_t base, HttpRequest &request, Handler &handler)
+    {
+        size_t pos = 0;
+        bool isFirst = true;
+        while (true)
+        {
+            size_t nl = pos + Scan::find(data.subspan(pos), '\n');
+            if (nl >= maxHead)
+                return -431;
+            if (nl == data.size())
+                return 0;
+            size_t end = nl > pos && data[nl - 1] == '\r' ? nl - 1 : nl;
+            std::string_view line(data.data() + pos, end - pos);
+            pos = nl + 1;
+            if (isFirst)
+            {
+                long e = requestLine(line, request);
+                if (e < 0)
+                    return e;
+                isFirst = false;
+                continue;
+            }
+            if (line.empty())
+                break;
+            if (request.headerCount == HttpRequest::maxHeaders)
+                return -431;
+            size_t colon = Scan::find(line, ':');
+            if (colon == 0 || colon == line.size() ||
+                line[colon - 1] == ' ' || line[colon - 1] == '\t')
+                return -400;
+            request.headers[request.headerCount++] = {line.substr(0, colon), trim(line.substr(colon + 1))};
+        }
+        // an empty Content-Length is still one, and malformed
+        std::string_view length;
+        bool isLength = false;
+        std::string_view coding;
+        for (size_t i = 0; i < request.headerCount; ++i)
+        {
+            const HttpHeader &header = request.headers[i];
+            if (HttpRequest::iequals(header.name, "Content-Length"))
+            {
+                if (isLength && length != header.value)
+                    return -400;
+                length = header.value;
+                isLength = true;
+            }
+            else if (HttpRequest::iequals(header.name, "Transfer-Encoding"))
+                coding = header.value;
+            else if (HttpRequest::iequals(header.name, "Connection"))
+            {
+                if (hasToken(header.value, "close"))
+                    request.isKeepAlive = false;
+                else if (hasToken(header.value, "keep-alive"))
+                    request.isKeepAlive = true;
+            }
+        }
+        // both framings at once is how requests get smuggled
+        if (!coding.empty())
+        {
+            if (isLength)
+                return -400;
+            size_t comma = coding.rfind(',');
+            if (!HttpRequest::iequals(trim(comma == std::string_view::npos ? coding : coding.substr(comma + 1)), "chunked"))
+                return -501;
+            return chunked(data, pos, base, request, handler);
+        }
+        if (isLength)
+        {
+            size_t len = 0;
+            auto [end, ec] = std::from_chars(length.data(), length.data() + length.size(), len);
+            if (ec != std::errc() || end != length.data() + length.size())
+                return -400;
+            if (len > maxBody)
+                return -413;
+            if (data.size() - pos < len)
+            {
+                handler.expectRecv(pos + len - data.size());
+                return 0;
+            }
+            request.body = std::string_view(data.data() + pos, len);
+            pos += len;
+        }
+        return static_cast<long>(pos);
+    }
+    // method SP target SP version
+    static long requestLine(std::string_view line, HttpRequest &request) noexcept
+    {
+        size_t sp = line.find(' ');
+        if (sp == 0 || sp == std::string_view::npos)
+            return -400;
+        request.method = line.substr(0, sp);
+        line.remove_prefix(sp + 1);
+        sp = line.find(' ');
+        if (sp == 0 || sp == std::string_view::npos)
+            return -400;
+        request.target = line.substr(0, sp);
+        request.version = line.substr(sp + 1);
+        if (request.version == "HTTP/1.1")
+            request.isKeepAlive = true;
+        else if (request.version == "HTTP/1.0")
+            request.isKeepAlive = false;
+        else
+            return request.version.starts_with("HTTP/") ? -505 : -400;
+        return 0;
+    }
+    // size [; extensions] CRLF data CRLF ... 0 CRLF [trailers] CRLF
+    // the chunks are checked as they arrive, the handler's mark keeps where that got to
+    // and the decoded size, the body is copied once the last chunk is in
+    long chunked(std::span<const char> data, size_t pos, size_t base, HttpRequest &request, Handler &handler)
+    {
+        size_t first = pos;
+        size_t length = 0;
+        if (handler.markOffset() > base + pos)
+        {
+            pos = handler.markOffset() - base;
+            length = handler.markValue();
+        }
+        while (true)
+        {
+            handler.mark(base + pos, length);
+            size_t nl = pos + Scan::find(data.subspan(pos), '\n');
+            if (nl == data.size())
+                return data.size() - pos > maxHead ? -400 : 0;
+            size_t size = 0;
+            if (!chunkSize(std::string_view(data.data() + pos, nl - pos), size))
+                return -400;
+            if (size == 0)
+                break;
+            pos = nl + 1;
+            if (size > maxBody - length)
+                return -413;
+            if (data.size() - pos < size + 2)
+            {
+                handler.expectRecv(pos + size + 2 - data.size());
+                return 0;
+            }
+            if (data[pos + size] != '\r' || data[pos + size + 1] != '\n')
+                return -400;
+            length += size;
+            pos += size + 2;
+        }
+        // trailers are skipped up to the empty line
+        size_t last = pos;
+        pos += Scan::find(data.subspan(pos), '\n') + 1;
+        while (true)
+        {
+            size_t nl = pos + Scan::find(data.subspan(pos), '\n');
+            if (nl == data.size())
+                return data.size() - pos > maxHead ? -431 : 0;
+            bool isEmpty = nl == pos || (nl == pos + 1 && data[pos] == '\r');
+            pos = nl + 1;
+            if (isEmpty)
+                break;
+        }
+        body_.clear();
+        body_.reserve(length);
+        for (size_t at = first; at < last;)
+        {
+            size_t nl = at + Scan::find(data.subspan(at), '\n');
+            size_t size = 0;
+            chunkSize(std::string_view(data.data() + at, nl - at), size);
+            body_.append(data.data() + nl + 1, size);
+            at = nl + 1 + size + 2;
+        }
+        handler.mark(0);
+        request.body = body_;
+        return static_cast<long>(pos);
+    }
+    // size [; extensions], false malformed
+    static bool chunkSize(std::string_view line, size_t &size) noexcept
+    {
+        line = trim(line.substr(0, line.find(';')));
+        auto [end, ec] = std::from_chars(line.data(), line.data() + line.size(), size, 16);
+        return !line.empty() && ec == std::errc() && end == line.data() + line.size();
+    }
+    static std::string_view trim(std::string_view s) noexcept
+    {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t' || s.front() == '\r'))
+            s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r'))
+            s.remove_suffix(1);
+        return s;
+    }
+    // a comma-separated list holds token, case-insensitive
+    static bool hasToken(std::string_view list, std::string_view token) noexcept
+    {
+        while (!list.empty())
+        {
+            size_t comma = list.find(',');
+            if (HttpRequest::iequals(trim(list.substr(0, comma)), token))
+                return true;
+            if (comma == std::string_view::npos)
+                break;
+            list.remove_prefix(comma + 1);
+        }
+        return false;
+    }
+};
+
+inline void Handler::process_http()
+{
+    thread_local Http<> http;
+    process(http);
+}
@@ -1,4 +1,6 @@
 #include "handler.hpp"
 #include "peer.hpp"
 #include "reactor.hpp"
-#include "proactor.hpp"
\ No newline at end of file
+#include "proactor.hpp"
+#include "codec.hpp"
+#include "http.hpp"
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/select.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <string>
@@ -229,6 +230,30 @@ public:
         }
         return 0;
     }
+    // n the bytes of the iovecs sent by one sendmsg(), may end inside any of them
+    // 0 EAGAIN
+    // -1 iov == nullptr || count == 0
+    // -2 sendmsg() error
+    ssize_t send(int fd, const iovec *iov, size_t count)
+    {
+        if (iov == nullptr || count == 0)
+            return -1;
+        msghdr msg{};
+        msg.msg_iov = const_cast<iovec *>(iov);
+        msg.msg_iovlen = count;
+        while (true)
+        {
+            ssize_t n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+            if (n >= 0)
+                return n;
+            if (errno == EAGAIN)
+                return 0;
+            if (errno == EINTR)
+                continue;
+            ::close(fd);
+            return -2;
+        }
+    }
     // n the bytes sent
     // -1 data == nullptr || len == 0
     // -2 send() error
@@ -278,6 +303,35 @@ public:
         }
         return sum;
     }
+    // n the bytes received straight into the handler's receive chain, at most len
+    // 0 EAGAIN
+    // -1 len == 0
+    // -2 readv() error
+    // -3 closed by the peer
+    ssize_t recv(int fd, Handler &handler, size_t len)
+    {
+        if (len == 0)
+            return -1;
+        size_t sum = 0;
+        while (sum < len)
+        {
+            iovec iov[4];
+            size_t count = handler.recvSpace(iov, sizeof(iov) / sizeof(iov[0]), len - sum);
+            ssize_t n = ::readv(fd, iov, count);
+            handler.recvCommit(n > 0 ? n : 0);
+            if (n <= 0)
+            {
+                if (n < 0 && errno == EAGAIN)
+                    break;
+                if (n < 0 && errno == EINTR)
+                    continue;
+                ::close(fd);
+                return n == 0 ? -3 : -2;
+            }
+            sum += static_cast<size_t>(n);
+        }
+        return sum;
+    }
     // 0 success
     // -1 ip error
     // -2 port error
@@ -692,7 +746,19 @@ public:
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <openssl/rand.h>
+#include <openssl/evp.h>
+#include <openssl/core_names.h>
 #include <signal.h>
+#include <malloc.h>
+#include <ctime>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <mutex>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
 
 class Peer_tls
 {
@@ -706,16 +772,218 @@ protected:
         SSL_CTX *ctx = nullptr;
         SSL *ssl = nullptr;
     } serInfo_, cliInfo_;
+    // client sessions by ip:port, reused on the next connect()
+    std::unordered_map<std::string, SSL_SESSION *> sessions_;
+    // the client connection is gone, its fd and ssl already released
+    // the context stays for the next connect(), sessions_ hangs off it
+    inline void dropCli() noexcept
+    {
+        SSL_CTX *ctx = cliInfo_.ctx;
+        cliInfo_ = {};
+        cliInfo_.ctx = ctx;
+    }
+    // records grow from one TCP segment to full size over a burst, so a slow link
+    // gets its first bytes before a whole 16 KiB record is encrypted and sent
+    struct Records
+    {
+        size_t count = 0;
+        std::chrono::steady_clock::time_point last{};
+        // SSL_write() must be retried with at least the same length
+        bool isPending = false;
+    };
+    static constexpr size_t smallRecord_ = 1369;
+    static constexpr size_t smallRecords_ = 40;
+    static constexpr std::chrono::seconds burstIdle_{1};
+    // OpenSSL heap in use and live SSL objects, see trackMemory()
+    struct Usage
+    {
+        std::atomic<long> bytes = 0;
+        std::atomic<long> ssls = 0;
+    };
+    static Usage &usage()
+    {
+        static Usage usage;
+        return usage;
+    }
+    // every SSL created afterwards carries its Records
+    static int recordsIndex()
+    {
+        static int index = SSL_get_ex_new_index(0, nullptr, newRecords, nullptr, freeRecords);
+        return index;
+    }
+    static void newRecords(void *, void *, CRYPTO_EX_DATA *data, int index, long, void *)
+    {
+        CRYPTO_set_ex_data(data, index, new (std::nothrow) Records);
+        ++usage().ssls;
+    }
+    static void freeRecords(void *, void *records, CRYPTO_EX_DATA *, int, long, void *)
+    {
+        delete reinterpret_cast<Records *>(records);
+        --usage().ssls;
+    }
+    static void *countMalloc(size_t n, const char *, int)
+    {
+        void *p = std::malloc(n);
+        if (p != nullptr)
+            usage().bytes += malloc_usable_size(p);
+        return p;
+    }
+    static void countFree(void *p, const char *, int)
+    {
+        if (p != nullptr)
+            usage().bytes -= malloc_usable_size(p);
+        std::free(p);
+    }
+    static void *countRealloc(void *p, size_t n, const char *file, int line)
+    {
+        if (n == 0)
+        {
+            countFree(p, file, line);
+            return nullptr;
+        }
+        long old = p != nullptr ? malloc_usable_size(p) : 0;
+        void *q = std::realloc(p, n);
+        if (q != nullptr)
+            usage().bytes += static_cast<long>(malloc_usable_size(q)) - old;
+        return q;
+    }
+    struct TicketKey
+    {
+        unsigned char name[16];
+        unsigned char aes[32];
+        unsigned char hmac[32];
+        time_t created = 0;
+    };
+    // shared by every server context in the process, so a ticket issued by one
+    // SO_REUSEPORT shard resumes on any other
+    // front() encrypts, older keys only decrypt until they expire
+    struct TicketKeys
+    {
+        std::mutex mutex;
+        std::vector<TicketKey> keys;
+        int lifetime_s = 3600;
+    };
+    static TicketKeys &ticketKeys()
+    {
+        static TicketKeys keys;
+        return keys;
+    }
+    // client randoms of accepted 0-RTT ClientHellos, a replay repeats its random
+    // OpenSSL refuses early data whose ticket age is off by more than 10s,
+    // so a strike only has to outlive that
+    struct EarlyStrikes
+    {
+        std::mutex mutex;
+        std::unordered_set<std::string> seen;
+        std::deque<std::pair<time_t, std::string>> order;
+        int window_s = 10;
+    };
+    static EarlyStrikes &earlyStrikes()
+    {
+        static EarlyStrikes strikes;
+        return strikes;
+    }
+    // 1 accept the early data, 0 reject it and fall back to 1-RTT
+    static int allowEarlyDataCb(SSL *ssl, void *)
+    {
+        std::string random(SSL3_RANDOM_SIZE, '\0');
+        if (SSL_get_client_random(ssl, reinterpret_cast<unsigned char *>(random.data()), random.size()) != random.size())
+            return 0;
+        EarlyStrikes &strikes = earlyStrikes();
+        std::lock_guard lock(strikes.mutex);
+        time_t now = time(nullptr);
+        while (!strikes.order.empty() && now - strikes.order.front().first >= strikes.window_s)
+        {
+            strikes.seen.erase(strikes.order.front().second);
+            strikes.order.pop_front();
+        }
+        if (!strikes.seen.insert(random).second)
+            return 0;
+        strikes.order.emplace_back(now, std::move(random));
+        return 1;
+    }
+    // 1 key found, 2 found but a fresh ticket is due
+    // 0 unknown key, full handshake
+    // -1 error
+    static int ticketKeyCb(SSL *ssl, unsigned char *name, unsigned char *iv,
+                           EVP_CIPHER_CTX *cipherCtx, EVP_MAC_CTX *macCtx, int isEncrypt)
+    {
+        TicketKeys &keys = ticketKeys();
+        std::lock_guard lock(keys.mutex);
+        time_t now = time(nullptr);
+        if (keys.keys.empty() || now - keys.keys.front().created >= keys.lifetime_s)
+        {
+            TicketKey key;
+            key.created = now;
+            if (RAND_bytes(key.name, sizeof(key.name)) <= 0 ||
+                RAND_bytes(key.aes, sizeof(key.aes)) <= 0 ||
+                RAND_bytes(key.hmac, sizeof(key.hmac)) <= 0)
+                return -1;
+            keys.keys.insert(keys.keys.begin(), key);
+        }
+        std::erase_if(keys.keys, [&](const TicketKey &key)
+                      { return now - key.created >= 2 * keys.lifetime_s; });
+        auto key = keys.keys.begin();
+        if (isEncrypt)
+        {
+            if (RAND_bytes(iv, 16) <= 0)
+                return -1;
+            std::memcpy(name, key->name, sizeof(key->name));
+        }
+        else
+        {
+            key = std::find_if(keys.keys.begin(), keys.keys.end(), [&](const TicketKey &key)
+                               { return std::memcmp(name, key.name, sizeof(key.name)) == 0; });
+            if (key == keys.keys.end())
+                return 0;
+        }
+        OSSL_PARAM params[] = {
+            OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key->hmac, sizeof(key->hmac)),
+            OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char *>("SHA256"), 0),
+            OSSL_PARAM_construct_end()};
+        if (EVP_MAC_CTX_set_params(macCtx, params) <= 0)
+            return -1;
+        if (isEncrypt)
+            return EVP_EncryptInit_ex(cipherCtx, EVP_aes_256_cbc(), nullptr, key->aes, iv) > 0 ? 1 : -1;
+        if (EVP_DecryptInit_ex(cipherCtx, EVP_aes_256_cbc(), nullptr, key->aes, iv) <= 0)
+            return -1;
+        // a TLS 1.3 ticket is single use, the resumed client needs another one
+        return key == keys.keys.begin() && SSL_version(ssl) < TLS1_3_VERSION ? 1 : 2;
+    }
+    // a TLS 1.3 ticket arrives after the handshake, so sessions are taken from here
+    static int newSessionCb(SSL *ssl, SSL_SESSION *session)
+    {
+        Peer_tls *peer = reinterpret_cast<Peer_tls *>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+        if (peer == nullptr || peer->cliInfo_.ip == nullptr)
+            return 0;
+        SSL_SESSION *&cached = peer->sessions_[std::string(peer->cliInfo_.ip) + ":" + std::to_string(peer->cliInfo_.port)];
+        SSL_SESSION_free(cached);
+        cached = session;
+        return 1;
+    }
 
 public:
+    // counts what OpenSSL allocates, must run before anything else calls into OpenSSL
+    // false too late, memory() then stays 0
+    static bool trackMemory() { return CRYPTO_set_mem_functions(countMalloc, countRealloc, countFree) == 1; }
+    // bytes OpenSSL holds in this process, read and write buffers of idle
+    // connections are released with SSL_MODE_RELEASE_BUFFERS
+    static size_t memory() { return std::max(0L, usage().bytes.load()); }
+    static size_t connections() { return std::max(0L, usage().ssls.load()); }
+    // includes the SSL_CTX and library state every connection shares
+    static size_t memoryPerConnection() { return memory() / std::max<size_t>(1, connections()); }
     Peer_tls() noexcept { signal(SIGPIPE, SIG_IGN); }
     ~Peer_tls() noexcept
     {
-        SSL_shutdown(serInfo_.ssl);
+        for (auto &[destination, session] : sessions_)
+            SSL_SESSION_free(session);
+        if (serInfo_.ssl != nullptr)
+            SSL_shutdown(serInfo_.ssl);
         SSL_free(serInfo_.ssl);
         ::close(serInfo_.fd);
         SSL_CTX_free(serInfo_.ctx);
-        SSL_shutdown(cliInfo_.ssl);
+        if (cliInfo_.ssl != nullptr)
+            SSL_shutdown(cliInfo_.ssl);
         SSL_free(cliInfo_.ssl);
         ::close(cliInfo_.fd);
         SSL_CTX_free(cliInfo_.ctx);
@@ -737,7 +1005,10 @@ public:
     // -9 SSL_CTX_use_certificate_file() error
     // -10 SSL_CTX_use_PrivateKey_file() error
     // -11 SSL_CTX_check_private_key() error
-    int listen(const char *ip, int port, const char *crt, const char *key, int backlog = 511)
+    // isKtls OpenSSL installs TCP_ULP tls after the handshake and falls back silently if it can't
+    // maxEarlyData TLS 1.3 0-RTT bytes accepted on resumption, 0 none
+    int listen(const char *ip, int port, const char *crt, const char *key, int backlog = 511, bool isKtls = false,
+               uint32_t maxEarlyData = 0)
     {
         if (ip == nullptr)
             return -1;
@@ -807,6 +1078,9 @@ public:
             serInfo_ = {};
             return -8;
         }
+        // a retried SSL_write() may come from another buffer holding the same bytes
+        SSL_CTX_set_mode(serInfo_.ctx, SSL_MODE_RELEASE_BUFFERS | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+        recordsIndex();
         if (SSL_CTX_use_certificate_file(serInfo_.ctx, crt, SSL_FILETYPE_PEM) <= 0)
         {
             ::close(serInfo_.fd);
@@ -828,15 +1102,71 @@ public:
             serInfo_ = {};
             return -11;
         }
+        if (isKtls)
+            SSL_CTX_set_options(serInfo_.ctx, SSL_OP_ENABLE_KTLS);
+        setResumption(serInfo_.ctx);
+        if (maxEarlyData > 0)
+            setEarlyData(serInfo_.ctx, maxEarlyData);
         return 0;
     }
+    // OpenSSL's own anti-replay turns tickets stateful and per context, the
+    // strike register keeps them stateless and covers every context in the process
+    static void setEarlyData(SSL_CTX *ctx, uint32_t maxEarlyData, int replayWindow_s = 10)
+    {
+        {
+            EarlyStrikes &strikes = earlyStrikes();
+            std::lock_guard lock(strikes.mutex);
+            strikes.window_s = std::max(10, replayWindow_s);
+        }
+        SSL_CTX_set_max_early_data(ctx, maxEarlyData);
+        SSL_CTX_set_recv_max_early_data(ctx, maxEarlyData);
+        SSL_CTX_set_options(ctx, SSL_OP_NO_ANTI_REPLAY);
+        SSL_CTX_set_allow_early_data_cb(ctx, allowEarlyDataCb, nullptr);
+    }
+    inline static bool isEarlyAccepted(SSL *ssl) { return ssl != nullptr && SSL_get_early_data_status(ssl) == SSL_EARLY_DATA_ACCEPTED; }
+    // server session cache for clients without tickets, stateless tickets for the rest
+    // ticket keys rotate every ticketKeyLifetime_s and decrypt for one more period
+    // failures only cost resumption, every handshake is then a full one
+    static void setResumption(SSL_CTX *ctx, int ticketKeyLifetime_s = 3600, long cacheSize = 20480)
+    {
+        static const unsigned char sessionIdContext[] = "mynet";
+        {
+            TicketKeys &keys = ticketKeys();
+            std::lock_guard lock(keys.mutex);
+            keys.lifetime_s = std::max(1, ticketKeyLifetime_s);
+        }
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ctx, cacheSize);
+        SSL_CTX_set_timeout(ctx, ticketKeyLifetime_s);
+        if (SSL_CTX_set_session_id_context(ctx, sessionIdContext, sizeof(sessionIdContext) - 1) <= 0 ||
+            SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticketKeyCb) <= 0)
+        {
+            fprintf(stderr, "setResumption() Error\n"); //
+            ERR_clear_error();
+        }
+    }
+    inline static bool isResumed(SSL *ssl) { return ssl != nullptr && SSL_session_reused(ssl) == 1; }
+    // the directions the kernel took over after the handshake
+    // 1 send, 2 recv, 3 both, 0 neither
+    static int ktls(SSL *ssl)
+    {
+        if (ssl == nullptr)
+            return 0;
+        int n = 0;
+        if (BIO_get_ktls_send(SSL_get_wbio(ssl)))
+            n |= 1;
+        if (BIO_get_ktls_recv(SSL_get_rbio(ssl)))
+            n |= 2;
+        return n;
+    }
     // pointer cli ssl pointer
     // nullptr accept() error
     // nullptr setsockopt() error
     // nullptr SSL_new() error
     // nullptr SSL_set_fd() error
     // nullptr SSL_accept() error
-    SSL *accept(int recvTimeout_s = 3, int recvTimeout_us = 0)
+    // isHandshake false: return before SSL_accept(), drive it with handshake()
+    SSL *accept(int recvTimeout_s = 3, int recvTimeout_us = 0, bool isHandshake = true)
     {
         Info accInfo{};
         socklen_t socklen = sizeof(sockaddr_in);
@@ -868,6 +1198,11 @@ public:
             accInfo = {};
             return nullptr;
         }
+        if (!isHandshake)
+        {
+            SSL_set_accept_state(accInfo.ssl);
+            return accInfo.ssl;
+        }
         int e;
         while ((e = SSL_accept(accInfo.ssl)) <= 0)
         {
@@ -882,6 +1217,76 @@ public:
         }
         return accInfo.ssl;
     }
+    // one non-blocking step that first serves 0-RTT data
+    // the answer goes out as 0.5-RTT data ahead of the client Finished, a part
+    // that doesn't fit stays in handler, see Handler::isSending()
+    // isEarly true until SSL_read_early_data() is done, start it as SSL_get_max_early_data() > 0
+    // protocol answers the early data, see Handler::process()
+    // same return values as below, -2 also SSL_read_early_data() error
+    template <typename Protocol>
+    static int handshake(SSL *ssl, bool &isEarly, Handler &handler, Protocol &protocol)
+    {
+        if (ssl == nullptr)
+            return -1;
+        while (isEarly)
+        {
+            iovec iov;
+            handler.recvSpace(&iov, 1, Handler::recvChunkSize);
+            size_t n = 0;
+            int e = SSL_read_early_data(ssl, iov.iov_base, iov.iov_len, &n);
+            handler.recvCommit(n, true);
+            if (e == SSL_READ_EARLY_DATA_ERROR)
+            {
+                e = SSL_get_error(ssl, e);
+                if (e == SSL_ERROR_WANT_READ)
+                    return 1;
+                if (e == SSL_ERROR_WANT_WRITE)
+                    return 2;
+                ERR_clear_error();
+                return -2;
+            }
+            if (e == SSL_READ_EARLY_DATA_FINISH)
+            {
+                isEarly = false;
+                continue;
+            }
+            handler.process(protocol);
+            if (handler.isResponse())
+            {
+                size_t sn = 0;
+                do
+                {
+                    if (SSL_write_early_data(ssl, handler.responseBegin(), handler.responseLength(), &sn) <= 0)
+                    {
+                        ERR_clear_error();
+                        break;
+                    }
+                } while (handler.stillSending(sn));
+            }
+        }
+        return handshake(ssl);
+    }
+    // one non-blocking SSL_accept() step
+    // 0 handshake done
+    // 1 wait for the fd to be readable
+    // 2 wait for the fd to be writable
+    // -1 ssl == nullptr
+    // -2 SSL_accept() error
+    static int handshake(SSL *ssl)
+    {
+        if (ssl == nullptr)
+            return -1;
+        int e = SSL_accept(ssl);
+        if (e > 0)
+            return 0;
+        e = SSL_get_error(ssl, e);
+        if (e == SSL_ERROR_WANT_READ)
+            return 1;
+        if (e == SSL_ERROR_WANT_WRITE)
+            return 2;
+        ERR_clear_error();
+        return -2;
+    }
     // user space blocking
     // 0 success
     // -1 ip error
@@ -897,25 +1302,32 @@ public:
     // -11 SSL_set_fd() error
     // -12 SSL_CTX_load_verify_locations() error
     // -13 SSL_connect() error
-    int connect(const char *ip, int port, const char *crt = nullptr, int recvTimeout_s = 60, int recvTimeout_us = 0)
+    // -14 SSL_write_early_data() or SSL_write() error
+    // early sent before connect() returns, as 0-RTT data when a cached session allows it,
+    // otherwise or if the server rejects it, right after the handshake
+    int connect(const char *ip, int port, const char *crt = nullptr, int recvTimeout_s = 60, int recvTimeout_us = 0,
+                std::string_view early = {})
     {
         if (cliInfo_.fd != -1)
         {
+            if (cliInfo_.ssl != nullptr)
+                SSL_shutdown(cliInfo_.ssl);
+            SSL_free(cliInfo_.ssl);
             ::close(cliInfo_.fd);
-            cliInfo_ = {};
+            dropCli();
         }
         if (ip == nullptr)
             return -1;
         cliInfo_.sockaddr.sin_family = AF_INET;
         if (::inet_pton(AF_INET, ip, &cliInfo_.sockaddr.sin_addr) <= 0)
         {
-            cliInfo_ = {};
+            dropCli();
             return -1;
         }
         cliInfo_.ip = ip;
         if (port < 0 || port > 65535)
         {
-            cliInfo_ = {};
+            dropCli();
             return -2;
         }
         cliInfo_.sockaddr.sin_port = ::htons(port);
@@ -923,7 +1335,7 @@ public:
         int fd = ::socket(AF_INET, SOCK_STREAM, 0);
         if (fd < 0)
         {
-            cliInfo_ = {};
+            dropCli();
             return -3;
         }
         cliInfo_.fd = fd;
@@ -931,13 +1343,13 @@ public:
         if ((flags = ::fcntl(cliInfo_.fd, F_GETFL, 0)) < 0)
         {
             ::close(cliInfo_.fd);
-            cliInfo_ = {};
+            dropCli();
             return -4;
         }
         if (::fcntl(cliInfo_.fd, F_SETFL, flags | O_NONBLOCK) < 0)
         {
             ::close(cliInfo_.fd);
-            cliInfo_ = {};
+            dropCli();
             return -4;
         }
         timeval timeout;
@@ -946,7 +1358,7 @@ public:
         if (::setsockopt(cliInfo_.fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0)
         {
             ::close(cliInfo_.fd);
-            cliInfo_ = {};
+            dropCli();
             return -5;
         }
         int n = ::connect(cliInfo_.fd, (const sockaddr *)&cliInfo_.sockaddr, sizeof(sockaddr_in));
@@ -955,7 +1367,7 @@ public:
             if (errno != EINPROGRESS)
             {
                 ::close(cliInfo_.fd);
-                cliInfo_ = {};
+                dropCli();
                 return -6;
             }
             fd_set writeFds;
@@ -965,13 +1377,13 @@ public:
             if (n < 0)
             {
                 ::close(cliInfo_.fd);
-                cliInfo_ = {};
+                dropCli();
                 return -6;
             }
             else if (n == 0)
             {
                 ::close(cliInfo_.fd);
-                cliInfo_ = {};
+                dropCli();
                 return -7;
             }
             else
@@ -981,7 +1393,7 @@ public:
                 if (::getsockopt(cliInfo_.fd, SOL_SOCKET, SO_ERROR, &n, &len) < 0 || n != 0)
                 {
                     ::close(cliInfo_.fd);
-                    cliInfo_ = {};
+                    dropCli();
                     return -6;
                 }
             }
@@ -1006,29 +1418,68 @@ public:
                 SSL_CTX_set_verify(cliInfo_.ctx, SSL_VERIFY_NONE, nullptr);
             else
                 SSL_CTX_set_verify(cliInfo_.ctx, SSL_VERIFY_PEER, nullptr);
+            SSL_CTX_set_mode(cliInfo_.ctx, SSL_MODE_RELEASE_BUFFERS | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+            recordsIndex();
+            SSL_CTX_set_session_cache_mode(cliInfo_.ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_sess_set_new_cb(cliInfo_.ctx, newSessionCb);
+            SSL_CTX_set_app_data(cliInfo_.ctx, this);
         }
         cliInfo_.ssl = SSL_new(cliInfo_.ctx);
         if (cliInfo_.ssl == nullptr)
         {
             ::close(cliInfo_.fd);
-            cliInfo_.fd = {};
+            dropCli();
             return -10;
         }
+        // an abbreviated handshake if the server still knows the session
+        auto cached = sessions_.find(std::string(ip) + ":" + std::to_string(port));
+        size_t earlyLength = 0;
+        // a TLS 1.3 session is spent once used, until its connection gets a new ticket
+        if (cached != sessions_.end() && SSL_SESSION_is_resumable(cached->second))
+        {
+            SSL_set_session(cliInfo_.ssl, cached->second);
+            earlyLength = std::min<size_t>(early.size(), SSL_SESSION_get_max_early_data(cached->second));
+        }
         if (SSL_set_fd(cliInfo_.ssl, cliInfo_.fd) <= 0)
         {
             SSL_free(cliInfo_.ssl);
             ::close(cliInfo_.fd);
-            cliInfo_ = {};
+            dropCli();
             return -11;
         }
         if (crt != nullptr && SSL_CTX_load_verify_locations(cliInfo_.ctx, crt, nullptr) <= 0)
         {
             SSL_free(cliInfo_.ssl);
             ::close(cliInfo_.fd);
-            cliInfo_ = {};
+            dropCli();
             return -12;
         }
         int e;
+        size_t sent = 0;
+        while (sent < earlyLength)
+        {
+            size_t n = 0;
+            if ((e = SSL_write_early_data(cliInfo_.ssl, early.data() + sent, earlyLength - sent, &n)) > 0)
+            {
+                sent += n;
+                continue;
+            }
+            e = SSL_get_error(cliInfo_.ssl, e);
+            if (e != SSL_ERROR_WANT_READ && e != SSL_ERROR_WANT_WRITE)
+            {
+                SSL_free(cliInfo_.ssl);
+                ::close(cliInfo_.fd);
+                dropCli();
+                return -14;
+            }
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(cliInfo_.fd, &fds);
+            if (e == SSL_ERROR_WANT_READ)
+                ::select(cliInfo_.fd + 1, &fds, nullptr, nullptr, &timeout);
+            else
+                ::select(cliInfo_.fd + 1, nullptr, &fds, nullptr, &timeout);
+        }
         while ((e = SSL_connect(cliInfo_.ssl)) <= 0)
         {
             e = SSL_get_error(cliInfo_.ssl, e);
@@ -1036,7 +1487,7 @@ public:
             {
                 SSL_free(cliInfo_.ssl);
                 ::close(cliInfo_.fd);
-                cliInfo_ = {};
+                dropCli();
                 return -13;
             }
             fd_set fds;
@@ -1047,6 +1498,27 @@ public:
             else
                 ::select(cliInfo_.fd + 1, nullptr, &fds, nullptr, &timeout);
         }
+        // a rejected 0-RTT flight is discarded by the server
+        if (sent > 0 && !isEarlyAccepted(cliInfo_.ssl))
+            sent = 0;
+        while (sent < early.size())
+        {
+            ssize_t n = send(cliInfo_.ssl, early.data() + sent, early.size() - sent);
+            // send() already closed the connection
+            if (n < 0)
+            {
+                dropCli();
+                return -14;
+            }
+            if (n == 0)
+            {
+                fd_set fds;
+                FD_ZERO(&fds);
+                FD_SET(cliInfo_.fd, &fds);
+                ::select(cliInfo_.fd + 1, nullptr, &fds, nullptr, &timeout);
+            }
+            sent += n;
+        }
         return 0;
     }
     // n the bytes sent
@@ -1056,16 +1528,27 @@ public:
     {
         if (ssl == nullptr || data == nullptr || len == 0)
             return -1;
+        Records *records = reinterpret_cast<Records *>(SSL_get_ex_data(ssl, recordsIndex()));
+        auto now = std::chrono::steady_clock::now();
+        if (records != nullptr && !records->isPending && now - records->last >= burstIdle_)
+            records->count = 0;
         size_t sum = 0;
         while (sum < len)
         {
-            ssize_t n = SSL_write(ssl, data + sum, len - sum);
+            size_t chunk = len - sum;
+            if (records != nullptr && records->count < smallRecords_)
+                chunk = std::min(chunk, smallRecord_);
+            ssize_t n = SSL_write(ssl, data + sum, chunk);
             if (n < 0)
             {
                 n = SSL_get_error(ssl, n);
                 if (n == SSL_ERROR_WANT_READ ||
                     n == SSL_ERROR_WANT_WRITE)
+                {
+                    if (records != nullptr)
+                        records->isPending = true;
                     break;
+                }
                 else
                 {
                     int fd = SSL_get_fd(ssl);
@@ -1077,10 +1560,73 @@ public:
                     return -2;
                 }
             }
+            if (records != nullptr)
+            {
+                records->count += (n + smallRecord_ - 1) / smallRecord_;
+                records->last = now;
+                records->isPending = false;
+            }
             sum += static_cast<size_t>(n);
         }
         return sum;
     }
+    // n the bytes of the file sent from offset
+    // 0 EAGAIN
+    // -1 ssl == nullptr || fileFd < 0 || len == 0
+    // -2 SSL_sendfile() || SSL_write() error
+    // -3 pread() error
+    // zero-copy with kTLS send, otherwise a chunk is read and encrypted in user space
+    // on EAGAIN the offset stays put, the next call reads the same chunk again and
+    // SSL_write() finishes the record it already holds
+    ssize_t sendfile(SSL *&ssl, int fileFd, off_t offset, size_t len)
+    {
+        if (ssl == nullptr || fileFd < 0 || len == 0)
+            return -1;
+        ssize_t n = 0;
+        if (ktls(ssl) & 1)
+        {
+            n = SSL_sendfile(ssl, fileFd, offset, len, 0);
+            if (n < 0)
+            {
+                int e = SSL_get_error(ssl, n);
+                if (e == SSL_ERROR_WANT_WRITE ||
+                    e == SSL_ERROR_WANT_READ)
+                    return 0;
+                n = -2;
+            }
+        }
+        else
+        {
+            char buf[16384];
+            n = ::pread(fileFd, buf, std::min(len, sizeof(buf)), offset);
+            if (n <= 0)
+                n = -3;
+            else
+            {
+                int wn = SSL_write(ssl, buf, n);
+                if (wn <= 0)
+                {
+                    int e = SSL_get_error(ssl, wn);
+                    if (e == SSL_ERROR_WANT_WRITE ||
+                        e == SSL_ERROR_WANT_READ)
+                        return 0;
+                    n = -2;
+                }
+                else
+                    n = wn;
+            }
+        }
+        if (n < 0)
+        {
+            int fd = SSL_get_fd(ssl);
+            SSL_shutdown(ssl);
+            SSL_free(ssl);
+            ::close(fd);
+            ssl = nullptr;
+            ERR_clear_error();
+        }
+        return n;
+    }
     // n the bytes received
     // 0 EAGAIN
     // -1 ssl == nullptr || buf == nullptr || len == 0
@@ -1114,6 +1660,39 @@ public:
         }
         return sum;
     }
+    // n the bytes received straight into the handler's receive chain, at most len
+    // 0 EAGAIN
+    // -1 ssl == nullptr || len == 0
+    // -2 SSL_read() error
+    ssize_t recv(SSL *&ssl, Handler &handler, size_t len)
+    {
+        if (ssl == nullptr || len == 0)
+            return -1;
+        size_t sum = 0;
+        while (sum < len)
+        {
+            iovec iov;
+            handler.recvSpace(&iov, 1, len - sum);
+            ssize_t n = ::SSL_read(ssl, iov.iov_base, iov.iov_len);
+            handler.recvCommit(n > 0 ? n : 0);
+            if (n <= 0)
+            {
+                n = SSL_get_error(ssl, n);
+                if (n == SSL_ERROR_WANT_READ ||
+                    n == SSL_ERROR_WANT_WRITE)
+                    break;
+                int fd = SSL_get_fd(ssl);
+                SSL_shutdown(ssl);
+                SSL_free(ssl);
+                ::close(fd);
+                ssl = nullptr;
+                ERR_clear_error();
+                return -2;
+            }
+            sum += static_cast<size_t>(n);
+        }
+        return sum;
+    }
     // single crt&pem format
     // 0 success
     // -1 ip error
@@ -1197,8 +1776,10 @@ public:
     // -11 SSL_set_fd() error
     // -12 SSL_CTX_load_verify_locations() error
     // -13 SSL_connect() error
+    // -14 SSL_write_early_data() or SSL_write() error
+    // isEarlyData a request interrupted by a reconnect rides in it as 0-RTT data
     int run_cli(const char *ip, int port, const char *crt = nullptr,
-                int recvTimeout_s = 60, int recvTimeout_us = 0)
+                int recvTimeout_s = 60, int recvTimeout_us = 0, bool isEarlyData = false)
     {
         int n = connect(ip, port, crt, recvTimeout_s, recvTimeout_us);
         if (n < 0)
@@ -1216,9 +1797,13 @@ public:
                     sn = send(ssl, handler.responseBegin(), handler.responseLength());
                     if (sn < 0)
                     {
-                        n = connect(ip, port, crt, recvTimeout_s, recvTimeout_us);
+                        std::string_view early;
+                        if (isEarlyData)
+                            early = std::string_view(handler.responseBegin(), handler.responseLength());
+                        n = connect(ip, port, crt, recvTimeout_s, recvTimeout_us, early);
                         if (n < 0)
                             return n;
+                        sn = early.size();
                     }
                 } while (handler.stillSending(sn));
             }
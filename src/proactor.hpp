@@ -3,17 +3,43 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <liburing.h>
 #include <string>
 #include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 #include <cstdlib>
 #include <stop_token>
+#include <chrono>
+#include <cassert>
 #include "concepts.hpp"
 
+template <typename Peer, is_protocol Protocol>
+class MultiProactor;
+
+// Protocol answers what every connection receives, see is_protocol
+template <typename Peer, is_protocol Protocol = Reflect>
 class Proactor
 {
+    friend class MultiProactor<Peer, Protocol>;
+
+public:
+    // DEFAULT io_uring_wait_cqe() then io_uring_submit() per batch
+    // THROUGHPUT SINGLE_ISSUER|DEFER_TASKRUN, one io_uring_submit_and_wait() per batch
+    // LATENCY SQPOLL kernel thread, idle time and cpu configurable
+    enum Profile
+    {
+        DEFAULT,
+        THROUGHPUT,
+        LATENCY
+    };
+
+private:
     struct Info
     {
         sockaddr_in sockaddr{};
@@ -22,22 +48,76 @@ class Proactor
         int fd = -1;
     } serInfo_;
     io_uring uring_;
-    int bgid_ = 1;
-    io_uring_buf_ring *bufRing_ = nullptr;
-    int maxBufEntrs_ = 0;
-    void *bufBase_ = nullptr;
+    struct BufGroup
+    {
+        int bgid = 0;
+        io_uring_buf_ring *ring = nullptr;
+        int entries = 0;
+        int size = 0;
+        char *base = nullptr;
+        // buffers lent to handlers as views
+        int held = 0;
+        // user space copy of the ring order, the kernel consumes entries from
+        // head and a bundle reports only its first buffer id
+        std::vector<unsigned short> order;
+        unsigned int head = 0;
+        unsigned int tail = 0;
+    };
+    // small, medium and large provided buffers
+    // each class has 4x the size and 1/4 the entries of the previous one
+    // a connection moves up a class once it fills a whole buffer
+    static constexpr int bufClasses_ = 3;
+    BufGroup bufGroups_[bufClasses_];
+    bool multishotAccept_ = true;
+    size_t sendZcThreshold_ = 0;
+    // connection fds are slots in a sparse registered file table
+    bool fixedFiles_ = false;
+    Profile profile_ = DEFAULT;
+    bool recvViews_ = false;
+    bool recvBundle_ = false;
+    // registered send buffers, one lent to each connection while they last
+    char *sendBufBase_ = nullptr;
+    int sendBufEntrs_ = 0;
+    size_t sendBufSize_ = 0;
+    std::vector<int> freeSendBufs_;
+    SSL_CTX *ctx_ = nullptr;
+    // type 0 accept
+    // type 1 recv
+    // type 2 send
+    // type 3 fd handed over by an acceptor ring
+    // type 4 stop wakeup
+    // type 5 fd handed over to a worker ring
+    // type 6 zero-copy send, released on its IORING_CQE_F_NOTIF completion
+    // type 7 fire and forget, only failures complete
+    // type 8 reclaim tick, see reclaimIdle()
     struct Event
     {
         int type = -1;
         int fd = -1;
         Handler *handler = nullptr;
+        Proactor *worker = nullptr;
+        // buffer class the recv is armed with, and the one to re-arm with
+        int group = 0;
+        int nextGroup = 0;
+        // TLS only, owned by the recv, borrowed by its sends
+        SSL *ssl = nullptr;
+        // recv only, ring clock of the last completion, ms
+        int64_t lastActive = 0;
+        // recv only, re-armed once the memory budget drains
+        bool isPaused = false;
         inline void reset() noexcept
         {
             type = -1;
             fd = -1;
             handler = nullptr;
+            worker = nullptr;
+            group = 0;
+            nextGroup = 0;
+            ssl = nullptr;
+            lastActive = 0;
+            isPaused = false;
         }
-    } accEvent_ = {.type = 0};
+    } accEvent_ = {.type = 0}, handEvent_ = {.type = 3}, wakeEvent_ = {.type = 4}, ignEvent_ = {.type = 7}, tickEvent_ = {.type = 8};
     template <Resettable Obj>
     class ObjPool
     {
@@ -75,18 +155,63 @@ class Proactor
             }
         }
         std::vector<Obj> &myPool() noexcept { return pool_; }
+        inline size_t inUse() const noexcept { return pool_.size() - available_.size(); }
     };
+    // every handler in use is charged here, destroyed after them
+    Budget budget_{&Budget::process()};
+    // recvs that wait for budget_ to drain
+    std::vector<Event *> paused_;
     ObjPool<Event> eventPool_;
     ObjPool<Handler> handlerPool_;
+    // multishot recvs that ended without a close, re-armed after the batch
+    std::vector<Event *> rearm_;
     std::stop_source stopSource_;
+    Protocol protocol_{};
+    int wakeFd_ = -1;
+    uint64_t wakeBuf_ = 0;
+    // see reclaimIdle()
+    unsigned int idle_ms_ = 0;
+    size_t retain_ = 256 * Handler::recvChunkSize;
+    int64_t now_ = 0;
+    int64_t lastSweep_ = 0;
+    __kernel_timespec tick_{};
+    bool isTicking_ = false;
+    // set by MultiProactor
+    // isWorker_ no listener, connections arrive from the acceptor ring
+    // workers_ accepted connections are handed over to these rings
+    bool isWorker_ = false;
+    std::vector<Proactor *> workers_;
+    // 0 starting, 1 ring ready, -1 exited
+    std::atomic<int> state_ = 0;
+    // live connections, read by the acceptor ring
+    std::atomic<int> load_ = 0;
 
 public:
-    Proactor() noexcept = default;
-    ~Proactor() noexcept { stop(); }
+    Proactor() noexcept { wakeFd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC); }
+    ~Proactor() noexcept
+    {
+        stop();
+        ::close(wakeFd_);
+    }
     Proactor(const Proactor &) = delete;
     Proactor &operator=(const Proactor &) = delete;
     Proactor(Proactor &&) noexcept = delete;
     Proactor &operator=(Proactor &&) noexcept = delete;
+    // the ring's own instance, configure it before run()
+    inline Protocol &protocol() noexcept { return protocol_; }
+    // connections idle for idle_ms give back their spare buffers, see Handler::reclaim(), 0 never
+    // the ring keeps at most retain bytes of drained receive chunks for reuse
+    // configure it before run()
+    inline void reclaimIdle(unsigned int idle_ms, size_t retain = 256 * Handler::recvChunkSize) noexcept
+    {
+        idle_ms_ = idle_ms;
+        retain_ = retain;
+    }
+    // the ring's buffered bytes, see Budget, 0 no limit
+    // the process-wide limits are set on Budget::process()
+    // configure it before run()
+    inline void memoryBudget(size_t soft, size_t hard) noexcept { budget_.limit(soft, hard); }
+    inline const Budget &budget() const noexcept { return budget_; }
     // 0 success
     // -1 ip error
     // -2 port error
@@ -99,11 +224,158 @@ public:
     // -9 posix_memalign() error
     // -10 io_uring_setup_buf_ring() error
     // -11 io_uring_submit() error
-    // -12 io_uring_wait_cqe() error
+    // -12 io_uring_wait_cqe() or io_uring_submit_and_wait() error
+    // -13 io_uring_register_files_sparse() error
+    // -14 io_uring_register_buffers() error
+    // multishotAccept one accept stays armed, maxAccepts is ignored
+    // sendZcThreshold responses of at least this many bytes use IORING_OP_SEND_ZC, 0 never
+    // fixedFiles accept into direct descriptors, one table slot per handler
+    // profile see Profile, the ring fd is registered in every profile
+    // sqThreadIdle_ms sqThreadCpu LATENCY only, cpu -1 leaves the thread unbound
+    // recvViews handlers read provided buffers in place, see Handler::RecvView
+    // the Protocol must have on_views(), see is_view_protocol, recvViews is ignored otherwise
+    // sendBufEntrs registered send buffers of sendBufSize, sent with
+    // IORING_RECVSEND_FIXED_BUF, 0 none
+    // recvBundle one completion may fill several buffers, ignored if the kernel lacks it
     int run(const char *ip, int port, int backlog = 511,
             unsigned int sqEntries = 512, unsigned int cqEntries = 1024,
             int maxAccepts = 256, size_t eventPoolSize = 256, size_t handlerPoolSize = 256,
-            int maxBufEntrs = 1024,  int bufSize = 4096)
+            int maxBufEntrs = 1024, int bufSize = 4096,
+            bool multishotAccept = true, size_t sendZcThreshold = 64 * 1024,
+            bool fixedFiles = false, Profile profile = DEFAULT,
+            unsigned int sqThreadIdle_ms = 1000, int sqThreadCpu = -1,
+            bool recvViews = false, int sendBufEntrs = 0, size_t sendBufSize = 64 * 1024,
+            bool recvBundle = false)
+        requires is_tcp<Peer>
+    {
+        return start(ip, port, backlog, sqEntries, cqEntries, maxAccepts, eventPoolSize, handlerPoolSize,
+                     maxBufEntrs, bufSize, multishotAccept, sendZcThreshold, fixedFiles, profile,
+                     sqThreadIdle_ms, sqThreadCpu, recvViews, sendBufEntrs, sendBufSize, recvBundle);
+    }
+    // single crt&pem format
+    // same arguments and return values as above, plus
+    // -15 SSL_CTX_new() error
+    // -16 SSL_CTX_use_certificate_file() error
+    // -17 SSL_CTX_use_PrivateKey_file() error
+    // -18 SSL_CTX_check_private_key() error
+    // io_uring moves ciphertext, OpenSSL runs over a memory BIO pair per connection
+    // recvViews is ignored, handlers only see plaintext
+    int run(const char *ip, int port, const char *crt, const char *key, int backlog = 511,
+            unsigned int sqEntries = 512, unsigned int cqEntries = 1024,
+            int maxAccepts = 256, size_t eventPoolSize = 256, size_t handlerPoolSize = 256,
+            int maxBufEntrs = 1024, int bufSize = 4096,
+            bool multishotAccept = true, size_t sendZcThreshold = 64 * 1024,
+            bool fixedFiles = false, Profile profile = DEFAULT,
+            unsigned int sqThreadIdle_ms = 1000, int sqThreadCpu = -1,
+            bool recvViews = false, int sendBufEntrs = 0, size_t sendBufSize = 64 * 1024,
+            bool recvBundle = false)
+        requires is_tls<Peer>
+    {
+        int n = newCtx(crt, key);
+        if (n == 0)
+            n = start(ip, port, backlog, sqEntries, cqEntries, maxAccepts, eventPoolSize, handlerPoolSize,
+                     maxBufEntrs, bufSize, multishotAccept, sendZcThreshold, fixedFiles, profile,
+                     sqThreadIdle_ms, sqThreadCpu, recvViews, sendBufEntrs, sendBufSize, recvBundle);
+        else
+        {
+            state_.store(-1);
+            state_.notify_all();
+        }
+        SSL_CTX_free(ctx_);
+        ctx_ = nullptr;
+        return n;
+    }
+    inline void stop() const noexcept
+    {
+        stopSource_.request_stop();
+        if (wakeFd_ != -1)
+            eventfd_write(wakeFd_, 1);
+    }
+
+private:
+    int start(const char *ip, int port, int backlog,
+              unsigned int sqEntries, unsigned int cqEntries,
+              int maxAccepts, size_t eventPoolSize, size_t handlerPoolSize,
+              int maxBufEntrs, int bufSize,
+              bool multishotAccept, size_t sendZcThreshold,
+              bool fixedFiles, Profile profile,
+              unsigned int sqThreadIdle_ms, int sqThreadCpu,
+              bool recvViews, int sendBufEntrs, size_t sendBufSize,
+              bool recvBundle)
+    {
+        recvBundle_ = recvBundle;
+        // provided buffers hold ciphertext under TLS, never views
+        recvViews_ = recvViews && !is_tls<Peer> && is_view_protocol<Protocol>;
+        if (recvViews && !recvViews_)
+            fprintf(stderr, "Proactor::run() recvViews ignored: %s\n", is_tls<Peer> ? "TLS" : "Protocol has no on_views()"); //
+        multishotAccept_ = multishotAccept;
+        sendZcThreshold_ = sendZcThreshold;
+        fixedFiles_ = fixedFiles;
+        profile_ = profile;
+        if (multishotAccept_)
+            maxAccepts = 1;
+        int n = 0;
+        if (!isWorker_)
+            n = listen(ip, port, backlog);
+        if (n == 0)
+            n = setup(sqEntries, cqEntries, eventPoolSize, handlerPoolSize, maxBufEntrs, bufSize,
+                      sqThreadIdle_ms, sqThreadCpu, sendBufEntrs, sendBufSize);
+        if (n == 0)
+        {
+            for (int i = 0; !isWorker_ && i < maxAccepts; ++i)
+                addAccept();
+            n = loop();
+        }
+        state_.store(-1);
+        state_.notify_all();
+        return n;
+    }
+    // -15 SSL_CTX_new() error
+    // -16 SSL_CTX_use_certificate_file() error
+    // -17 SSL_CTX_use_PrivateKey_file() error
+    // -18 SSL_CTX_check_private_key() error
+    int newCtx(const char *crt, const char *key)
+    {
+        ctx_ = SSL_CTX_new(TLS_server_method());
+        if (ctx_ == nullptr)
+            return -15;
+        SSL_CTX_set_mode(ctx_, SSL_MODE_RELEASE_BUFFERS);
+        int n = 0;
+        if (SSL_CTX_use_certificate_file(ctx_, crt, SSL_FILETYPE_PEM) <= 0)
+            n = -16;
+        else if (SSL_CTX_use_PrivateKey_file(ctx_, key, SSL_FILETYPE_PEM) <= 0)
+            n = -17;
+        else if (SSL_CTX_check_private_key(ctx_) <= 0)
+            n = -18;
+        else
+            Peer::setResumption(ctx_);
+        if (n < 0)
+        {
+            SSL_CTX_free(ctx_);
+            ctx_ = nullptr;
+        }
+        return n;
+    }
+    // the SSL owns both BIOs
+    SSL *newSsl()
+    {
+        SSL *ssl = SSL_new(ctx_);
+        if (ssl == nullptr)
+            return nullptr;
+        BIO *rbio = BIO_new(BIO_s_mem());
+        BIO *wbio = BIO_new(BIO_s_mem());
+        if (rbio == nullptr || wbio == nullptr)
+        {
+            BIO_free(rbio);
+            BIO_free(wbio);
+            SSL_free(ssl);
+            return nullptr;
+        }
+        SSL_set_bio(ssl, rbio, wbio);
+        SSL_set_accept_state(ssl);
+        return ssl;
+    }
+    int listen(const char *ip, int port, int backlog)
     {
         if (ip == nullptr)
             return -1;
@@ -166,54 +438,160 @@ public:
             serInfo_ = {};
             return -7;
         }
+        return 0;
+    }
+    int setup(unsigned int sqEntries, unsigned int cqEntries,
+              size_t eventPoolSize, size_t handlerPoolSize,
+              int maxBufEntrs, int bufSize,
+              unsigned int sqThreadIdle_ms, int sqThreadCpu,
+              int sendBufEntrs, size_t sendBufSize)
+    {
         io_uring_params params = {};
         params.flags = IORING_SETUP_CQSIZE;
         params.cq_entries = cqEntries;
+        switch (profile_)
+        {
+        case THROUGHPUT:
+            params.flags |= IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+            break;
+        case LATENCY:
+            params.flags |= IORING_SETUP_SQPOLL;
+            params.sq_thread_idle = sqThreadIdle_ms;
+            if (sqThreadCpu >= 0)
+            {
+                params.flags |= IORING_SETUP_SQ_AFF;
+                params.sq_thread_cpu = sqThreadCpu;
+            }
+            break;
+        default:
+            break;
+        }
         if (io_uring_queue_init_params(sqEntries, &uring_, &params) < 0)
         {
             ::close(serInfo_.fd);
             serInfo_ = {};
             return -8;
         }
-        maxBufEntrs_ = maxBufEntrs;
-        if (maxBufEntrs_ != 0 && posix_memalign(&bufBase_, 4096, maxBufEntrs_ * bufSize) != 0)
+        if (recvBundle_ && !(params.features & IORING_FEAT_RECVSEND_BUNDLE))
         {
-            ::close(serInfo_.fd);
-            serInfo_ = {};
-            return -9;
+            fprintf(stderr, "IORING_RECVSEND_BUNDLE Unsupported\n"); //
+            recvBundle_ = false;
         }
-        int err = 0;
-        if ((bufRing_ = io_uring_setup_buf_ring(&uring_, maxBufEntrs_, bgid_, 0, &err)) == nullptr)
+        // skips the fd table lookup on every io_uring_enter(), optional on old kernels
+        if (io_uring_register_ring_fd(&uring_) < 0)
+            fprintf(stderr, "io_uring_register_ring_fd() Error\n"); //
+        if (fixedFiles_ && io_uring_register_files_sparse(&uring_, handlerPoolSize) < 0)
         {
+            io_uring_queue_exit(&uring_);
             ::close(serInfo_.fd);
             serInfo_ = {};
-            return -10;
+            return -13;
+        }
+        // an acceptor ring never receives
+        for (int i = 0; workers_.empty() && maxBufEntrs > 0 && i < bufClasses_; ++i)
+        {
+            BufGroup &group = bufGroups_[i];
+            group.bgid = i + 1;
+            group.entries = std::max(1, maxBufEntrs >> (2 * i));
+            group.size = bufSize << (2 * i);
+            void *base = nullptr;
+            if (posix_memalign(&base, 4096, (size_t)group.entries * group.size) != 0)
+            {
+                freeBufGroups();
+                io_uring_queue_exit(&uring_);
+                ::close(serInfo_.fd);
+                serInfo_ = {};
+                return -9;
+            }
+            group.base = (char *)base;
+            int err = 0;
+            if ((group.ring = io_uring_setup_buf_ring(&uring_, group.entries, group.bgid, 0, &err)) == nullptr)
+            {
+                freeBufGroups();
+                io_uring_queue_exit(&uring_);
+                ::close(serInfo_.fd);
+                serInfo_ = {};
+                return -10;
+            }
+            group.order.resize(group.entries);
+            for (int j = 0; j < group.entries; ++j)
+            {
+                io_uring_buf_ring_add(group.ring, group.base + j * group.size, group.size, j, io_uring_buf_ring_mask(group.entries), j);
+                group.order[j] = j;
+            }
+            io_uring_buf_ring_advance(group.ring, group.entries);
+            group.tail = group.entries;
+        }
+        rearm_.reserve(eventPoolSize);
+        if (workers_.empty() && sendBufEntrs > 0)
+        {
+            void *base = nullptr;
+            if (posix_memalign(&base, 4096, sendBufEntrs * sendBufSize) != 0)
+            {
+                freeBufGroups();
+                io_uring_queue_exit(&uring_);
+                ::close(serInfo_.fd);
+                serInfo_ = {};
+                return -9;
+            }
+            sendBufBase_ = (char *)base;
+            sendBufEntrs_ = sendBufEntrs;
+            sendBufSize_ = sendBufSize;
+            std::vector<iovec> iovs(sendBufEntrs_);
+            for (int i = 0; i < sendBufEntrs_; ++i)
+                iovs[i] = {sendBufBase_ + i * sendBufSize_, sendBufSize_};
+            if (io_uring_register_buffers(&uring_, iovs.data(), iovs.size()) < 0)
+            {
+                freeSendBufs();
+                freeBufGroups();
+                io_uring_queue_exit(&uring_);
+                ::close(serInfo_.fd);
+                serInfo_ = {};
+                return -14;
+            }
+            freeSendBufs_.reserve(sendBufEntrs_);
+            for (int i = sendBufEntrs_ - 1; i >= 0; --i)
+                freeSendBufs_.push_back(i);
         }
-        for (int i = 0; i < maxBufEntrs_; ++i)
-            io_uring_buf_ring_add(bufRing_, (char *)bufBase_ + i * bufSize, bufSize, i, io_uring_buf_ring_mask(maxBufEntrs_), i);
-        io_uring_buf_ring_advance(bufRing_, maxBufEntrs_);
-        for (int i = 0; i < maxAccepts; ++i)
-            addAccept();
         eventPool_.init(eventPoolSize);
         handlerPool_.init(handlerPoolSize);
+        Handler::recvSlabCapacity(retain_ / Handler::recvChunkSize);
+        addWake();
+        // an acceptor ring holds no connections
+        if (idle_ms_ > 0 && workers_.empty())
+            addTick();
+        state_.store(1);
+        state_.notify_all();
+        return 0;
+    }
+    int loop()
+    {
         if (io_uring_submit(&uring_) < 0)
         {
-            ::close(serInfo_.fd);
-            serInfo_ = {};
+            teardown();
             return -11;
         }
         while (!stopSource_.stop_requested())
         {
             io_uring_cqe *cqe;
-            int e = io_uring_wait_cqe(&uring_, &cqe);
+            int e = 0;
+            if (profile_ == DEFAULT)
+                e = io_uring_wait_cqe(&uring_, &cqe);
+            else
+                e = io_uring_submit_and_wait(&uring_, 1);
             if (e < 0)
             {
                 if (e == -EINTR)
                     continue;
-                ::close(serInfo_.fd);
-                serInfo_ = {};
-                return -12;
+                // completions are pending, reap them before submitting again
+                if (e != -EAGAIN && e != -EBUSY)
+                {
+                    teardown();
+                    return -12;
+                }
             }
+            if (idle_ms_ > 0)
+                now_ = clock_ms();
             unsigned int head = 0;
             unsigned int count = 0;
             io_uring_for_each_cqe(&uring_, head, cqe)
@@ -222,32 +600,84 @@ public:
                 Event *event = reinterpret_cast<Event *>(io_uring_cqe_get_data(cqe));
                 int n = cqe->res;
                 if (n < 0)
-                    switch (-n)
+                {
+                    switch (event->type)
                     {
-                    case ENOBUFS:
-                        fprintf(stderr, "No Buffers\n"); //
-                        if (event->type == 1)
+                    case 0:
+                        fprintf(stderr, "Accept Error: %d\n", -n); //
+                        if (!multishotAccept_ || !(cqe->flags & IORING_CQE_F_MORE))
+                            addAccept();
+                        break;
+                    case 1:
+                        switch (-n)
                         {
-                            ::close(event->fd);
-                            handlerPool_.release(event->handler);
-                            eventPool_.release(event);
+                        case ENOBUFS:
+                            // wait for the batch to give buffers back, a large
+                            // class falls back to the smaller one with more entries
+                            if (event->nextGroup > 0)
+                                --event->nextGroup;
+                            rearm_.push_back(event);
+                            break;
+                        case ECANCELED:
+                            // moving to another buffer class
+                            rearm_.push_back(event);
+                            break;
+                        default:
+                            fprintf(stderr, "Unhandle Error: %d\n", -n); //
+                            closeConn(event);
+                            break;
                         }
                         break;
-                    default:
+                    case 2:
+                    case 6:
+                        // the multishot recv on this fd owns the teardown
                         fprintf(stderr, "Unhandle Error: %d\n", -n); //
-                        ::close(event->fd);
-                        handlerPool_.release(event->handler);
+                        shutdownFd(event->fd);
+                        if (!(cqe->flags & IORING_CQE_F_MORE))
+                        {
+                            unrefConn(event->fd, event->handler, event->ssl);
+                            eventPool_.release(event);
+                        }
+                        break;
+                    case 5:
+                        fprintf(stderr, "Handover Error: %d\n", -n); //
+                        closeFd(event->fd);
+                        --event->worker->load_;
                         eventPool_.release(event);
                         break;
+                    case 8:
+                        // -ETIME the tick is due, anything else the ring is going away
+                        isTicking_ = false;
+                        if (-n == ETIME)
+                        {
+                            if (idle_ms_ > 0 && now_ - lastSweep_ >= sweepInterval())
+                                sweep();
+                            addTick();
+                        }
+                        break;
+                    default:
+                        break;
                     }
+                    continue;
+                }
                 int e = 0;
                 switch (event->type)
                 {
                 case 0:
-                    e = addAccept();
-                    if (e < 0)
-                        goto error;
-                    e = addRecv_multishot(n);
+                    if ((!multishotAccept_ || !(cqe->flags & IORING_CQE_F_MORE)) && addAccept() < 0)
+                        fprintf(stderr, "Event Error: %d\n", -1); //
+                    if (!workers_.empty())
+                        e = addHandover(n);
+                    // over the hard limit, refused
+                    else if (budget_.isHard())
+                        closeFd(n);
+                    else
+                    {
+                        ++load_;
+                        e = addRecv_multishot(n);
+                        if (e < 0)
+                            --load_;
+                    }
                     if (e < 0)
                         goto error;
                     break;
@@ -255,43 +685,138 @@ public:
                 {
                     int fd = event->fd;
                     Handler *handler = event->handler;
+                    event->lastActive = now_;
                     if (cqe->flags & IORING_CQE_F_BUFFER)
                     {
-                        unsigned short bid = cqe->flags >> 16;
-                        char *buf = (char *)bufBase_ + (bid * bufSize);
-                        handler->appendRecvStream(buf, n);
-                        handler->process_reflect();
-                        if (handler->isResponse())
+                        // a bundle fills consecutive ring entries, the handler sees the
+                        // whole burst in a single call
+                        // the kernel names the first buffer, the ring order the ones after it
+                        BufGroup &group = bufGroups_[event->group];
+                        unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                        assert(!recvBundle_ || group.order[group.head & io_uring_buf_ring_mask(group.entries)] == bid);
+                        int left = n;
+                        bool isFirst = true;
+                        do
                         {
-                            e = addSend(fd, handler);
-                            if (e < 0)
-                                goto error;
+                            if (recvBundle_ && !isFirst)
+                                bid = group.order[group.head & io_uring_buf_ring_mask(group.entries)];
+                            isFirst = false;
+                            ++group.head;
+                            int len = std::min(left, group.size);
+                            char *buf = group.base + bid * group.size;
+                            if (recvViews_)
+                            {
+                                handler->lendRecvView({std::string_view(buf, len), event->group, bid});
+                                ++group.held;
+                            }
+                            else
+                            {
+                                if constexpr (is_tls<Peer>)
+                                    BIO_write(SSL_get_rbio(event->ssl), buf, len);
+                                else
+                                    handler->appendRecvStream(buf, len);
+                                recycleBuf(event->group, bid);
+                            }
+                            left -= len;
+                        } while (left > 0);
+                        if (recvViews_)
+                            e = respond(fd, handler);
+                        else if constexpr (is_tls<Peer>)
+                            e = respondTls(fd, handler, event->ssl);
+                        else
+                        {
+                            handler->process(protocol_);
+                            if (handler->isResponse())
+                                e = addSend(fd, handler);
+                            else if (handler->isClosed())
+                                shutdownFd(fd);
+                        }
+                        shed(event, cqe->flags & IORING_CQE_F_MORE);
+                        if (n >= group.size && event->nextGroup == event->group && event->group + 1 < bufClasses_)
+                        {
+                            ++event->nextGroup;
+                            if (cqe->flags & IORING_CQE_F_MORE)
+                                cancelRecv(event);
                         }
-                        io_uring_buf_ring_add(bufRing_, buf, bufSize, bid, io_uring_buf_ring_mask(maxBufEntrs_), 0);
-                        io_uring_buf_ring_advance(bufRing_, 1);
                     }
+                    // n == 0 the peer closed, otherwise the kernel ended the multishot
                     if (!(cqe->flags & IORING_CQE_F_MORE))
                     {
-                        ::close(fd);
-                        handlerPool_.release(handler);
-                        eventPool_.release(event);
+                        if (n == 0)
+                            closeConn(event);
+                        else
+                            rearm_.push_back(event);
                     }
+                    if (e < 0)
+                        goto error;
                     break;
                 }
                 case 2:
+                case 6:
                 {
                     int fd = event->fd;
                     Handler *handler = event->handler;
-                    if (handler->stillSending(n))
+                    SSL *ssl = event->ssl;
+                    // IORING_CQE_F_NOTIF the kernel no longer reads the buffer
+                    // IORING_CQE_F_MORE keep the event until that notification
+                    if (!(cqe->flags & IORING_CQE_F_NOTIF))
                     {
-                        e = addSend(fd, handler);
-                        if (e < 0)
-                            goto error;
+                        if (handler->stillSending(n))
+                            e = addSend(fd, handler, ssl);
+                        // the multishot recv sees the EOF and tears down
+                        else if (handler->isClosed())
+                            shutdownFd(fd);
                     }
-                    else
+                    if (!(cqe->flags & IORING_CQE_F_MORE))
+                    {
                         eventPool_.release(event);
+                        // views, records or bytes that came in while the response was pinned
+                        if (unrefConn(fd, handler, ssl) && e == 0)
+                        {
+                            if constexpr (is_tls<Peer>)
+                                e = answerTls(fd, handler, ssl, handler->recvSize() > 0);
+                            else if (recvViews_)
+                            {
+                                if (!handler->recvViews().empty())
+                                    e = respond(fd, handler);
+                            }
+                            else if (handler->recvSize() > 0)
+                            {
+                                handler->process(protocol_);
+                                if (handler->isResponse())
+                                    e = addSend(fd, handler);
+                                else if (handler->isClosed())
+                                    shutdownFd(fd);
+                            }
+                        }
+                    }
+                    if (e < 0)
+                        goto error;
                     break;
                 }
+                case 3:
+                    // load_ was already counted by the acceptor ring
+                    if (budget_.isHard())
+                    {
+                        closeFd(n);
+                        --load_;
+                        break;
+                    }
+                    e = addRecv_multishot(n);
+                    if (e < 0)
+                    {
+                        --load_;
+                        goto error;
+                    }
+                    break;
+                case 4:
+                    break;
+                case 5:
+                    // a direct descriptor was installed in the worker table, drop ours
+                    if (fixedFiles_)
+                        closeFd(event->fd);
+                    eventPool_.release(event);
+                    break;
                 default:
                 error:
                     fprintf(stderr, "Event Error: %d\n", e); //
@@ -299,105 +824,603 @@ public:
                 }
             }
             io_uring_cq_advance(&uring_, count);
-            io_uring_submit(&uring_);
+            if (!paused_.empty() && !budget_.isSoft())
+            {
+                for (Event *event : paused_)
+                    if (event->isPaused)
+                    {
+                        event->isPaused = false;
+                        rearm_.push_back(event);
+                    }
+                paused_.clear();
+            }
+            // a class with every buffer lent out waits for views to come back
+            // a paused recv waits for the budget instead
+            std::erase_if(rearm_, [this](Event *event)
+                          {
+                              if (event->isPaused)
+                              {
+                                  paused_.push_back(event);
+                                  return true;
+                              }
+                              if (!pickGroup(event))
+                                  return false;
+                              if (armRecv(event) < 0)
+                                  closeConn(event);
+                              return true; });
+            if (!paused_.empty())
+                addTick();
+            if (profile_ == DEFAULT)
+                io_uring_submit(&uring_);
         }
+        teardown();
+        return 0;
+    }
+    void teardown()
+    {
         if (serInfo_.fd != -1)
         {
             ::close(serInfo_.fd);
             serInfo_.fd = -1;
         }
-        if (bufRing_ != nullptr)
-        {
-            io_uring_free_buf_ring(&uring_, bufRing_, maxBufEntrs_, bgid_);
-            bufRing_ = nullptr;
-        }
-        if (bufBase_ != nullptr)
-        {
-            std::free(bufBase_);
-            bufBase_ = nullptr;
-        }
+        freeBufGroups();
+        rearm_.clear();
         io_uring_queue_exit(&uring_);
+        freeSendBufs();
+        // direct descriptors go away with the ring
+        // a connection's ssl is shared by its recv and sends, freed once
+        std::vector<SSL *> ssls;
         for (auto &event : eventPool_.myPool())
             if (event.fd != -1)
             {
-                ::close(event.fd);
+                if (event.ssl != nullptr)
+                    ssls.push_back(event.ssl);
+                event.ssl = nullptr;
+                if (!fixedFiles_)
+                    ::close(event.fd);
                 event.fd = -1;
             }
+        std::sort(ssls.begin(), ssls.end());
+        ssls.erase(std::unique(ssls.begin(), ssls.end()), ssls.end());
+        for (SSL *ssl : ssls)
+            SSL_free(ssl);
+    }
+    void freeBufGroups()
+    {
+        for (BufGroup &group : bufGroups_)
+        {
+            if (group.ring != nullptr)
+                io_uring_free_buf_ring(&uring_, group.ring, group.entries, group.bgid);
+            std::free(group.base);
+            group = {};
+        }
+    }
+    void freeSendBufs()
+    {
+        std::free(sendBufBase_);
+        sendBufBase_ = nullptr;
+        sendBufEntrs_ = 0;
+        sendBufSize_ = 0;
+        freeSendBufs_.clear();
+    }
+    inline void recycleBuf(int group, unsigned short bid)
+    {
+        BufGroup &g = bufGroups_[group];
+        io_uring_buf_ring_add(g.ring, g.base + bid * g.size, g.size, bid, io_uring_buf_ring_mask(g.entries), 0);
+        io_uring_buf_ring_advance(g.ring, 1);
+        g.order[g.tail & io_uring_buf_ring_mask(g.entries)] = bid;
+        ++g.tail;
+    }
+    // sends still in flight fail fast on the shut down fd and drop the last reference
+    inline void closeConn(Event *event)
+    {
+        int fd = event->fd;
+        Handler *handler = event->handler;
+        SSL *ssl = event->ssl;
+        eventPool_.release(event);
+        if (unrefConn(fd, handler, ssl))
+            shutdownFd(fd);
+    }
+    // the fd is closed and the ssl freed only once no send is in flight,
+    // so neither can be reused or freed under one
+    // true the connection is still alive
+    inline bool unrefConn(int fd, Handler *handler, SSL *ssl = nullptr)
+    {
+        if (handler->unref() > 0)
+            return true;
+        SSL_free(ssl);
+        closeFd(fd);
+        handler->reclaimRecvViews([this](const Handler::RecvView &view)
+                                  { giveBackView(view); }, true);
+        if (handler->sendBufferIndex() >= 0)
+            freeSendBufs_.push_back(handler->sendBufferIndex());
+        handlerPool_.release(handler);
+        --load_;
+        return false;
+    }
+    inline void giveBackView(const Handler::RecvView &view)
+    {
+        --bufGroups_[view.group].held;
+        recycleBuf(view.group, view.bid);
+    }
+    // released views go back once no response points into them, then the new ones are handed over
+    int respond(int fd, Handler *handler)
+    {
+        if (!handler->isSending() && !handler->isPinned())
+            handler->reclaimRecvViews([this](const Handler::RecvView &view)
+                                      { giveBackView(view); });
+        if constexpr (is_view_protocol<Protocol>)
+            handler->process_view(protocol_);
+        if (handler->isResponse())
+            return addSend(fd, handler);
+        return 0;
+    }
+    // plaintext from the read BIO, reading also drives the handshake
+    // a TLS failure shuts the fd down and the multishot recv owns the teardown
+    int respondTls(int fd, Handler *handler, SSL *ssl)
+    {
+        int n = 0;
+        bool isData = false;
+        while (true)
+        {
+            iovec iov;
+            handler->recvSpace(&iov, 1, Handler::recvChunkSize);
+            n = SSL_read(ssl, iov.iov_base, iov.iov_len);
+            handler->recvCommit(n > 0 ? n : 0);
+            if (n <= 0)
+                break;
+            isData = true;
+        }
+        int e = SSL_get_error(ssl, n);
+        if (e != SSL_ERROR_WANT_READ)
+        {
+            // close_notify ends the connection like a plain EOF
+            if (e != SSL_ERROR_ZERO_RETURN)
+                fprintf(stderr, "SSL_read() Error: %d\n", e); //
+            ERR_clear_error();
+            shutdownFd(fd);
+            return 0;
+        }
+        return answerTls(fd, handler, ssl, isData);
+    }
+    // isData plaintext is waiting, the requests in it are answered and their records
+    // go out unless a send is in flight, its completion comes back here
+    int answerTls(int fd, Handler *handler, SSL *ssl, bool isData)
+    {
+        if (isData)
+        {
+            handler->process(protocol_);
+            // every queued segment is encrypted and the response replaced by its records
+            // a pinned one is left alone
+            if (handler->isResponse())
+            {
+                iovec iov[64];
+                size_t sum = 0;
+                do
+                {
+                    size_t count = handler->responseIov(iov, sizeof(iov) / sizeof(iov[0]));
+                    sum = 0;
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        if (SSL_write(ssl, iov[i].iov_base, iov[i].iov_len) <= 0)
+                        {
+                            ERR_clear_error();
+                            shutdownFd(fd);
+                            return -1;
+                        }
+                        sum += iov[i].iov_len;
+                    }
+                } while (handler->stillSending(sum));
+            }
+            if (!handler->isPinned())
+                handler->clearResponse();
+        }
+        int e = flushTls(fd, handler, ssl);
+        // nothing went out, a send in flight closes on its completion
+        if (e == 0 && handler->isClosed() && !handler->isPinned())
+            shutdownFd(fd);
+        return e;
+    }
+    // records wait in the write BIO while a send is in flight
+    int flushTls(int fd, Handler *handler, SSL *ssl)
+    {
+        BIO *wbio = SSL_get_wbio(ssl);
+        if (handler->isPinned() || BIO_ctrl_pending(wbio) == 0)
+            return 0;
+        char *data = nullptr;
+        long length = BIO_get_mem_data(wbio, &data);
+        handler->clearResponse();
+        handler->appendResponse(std::string_view(data, length));
+        (void)BIO_reset(wbio);
+        if (handler->isResponse())
+            return addSend(fd, handler, ssl);
+        return 0;
+    }
+    // false every class has all its buffers lent out
+    bool pickGroup(Event *event)
+    {
+        if (bufGroups_[event->nextGroup].held < bufGroups_[event->nextGroup].entries)
+            return true;
+        for (int i = 0; i < bufClasses_; ++i)
+            if (bufGroups_[i].held < bufGroups_[i].entries)
+            {
+                event->nextGroup = i;
+                return true;
+            }
+        return false;
+    }
+    inline io_uring_sqe *getSqe()
+    {
+        io_uring_sqe *sqe = io_uring_get_sqe(&uring_);
+        if (sqe == nullptr)
+        {
+            io_uring_submit(&uring_);
+            sqe = io_uring_get_sqe(&uring_);
+        }
+        return sqe;
+    }
+    // direct descriptors are closed asynchronously
+    void closeFd(int fd)
+    {
+        if (!fixedFiles_)
+        {
+            ::close(fd);
+            return;
+        }
+        io_uring_sqe *sqe = getSqe();
+        if (sqe == nullptr)
+        {
+            fprintf(stderr, "Close Error: %d\n", fd); //
+            return;
+        }
+        io_uring_prep_close_direct(sqe, fd);
+        io_uring_sqe_set_data(sqe, &ignEvent_);
+        sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+    }
+    void shutdownFd(int fd)
+    {
+        if (!fixedFiles_)
+        {
+            ::shutdown(fd, SHUT_RDWR);
+            return;
+        }
+        io_uring_sqe *sqe = getSqe();
+        if (sqe == nullptr)
+        {
+            fprintf(stderr, "Shutdown Error: %d\n", fd); //
+            return;
+        }
+        io_uring_prep_shutdown(sqe, fd, SHUT_RDWR);
+        io_uring_sqe_set_data(sqe, &ignEvent_);
+        sqe->flags |= IOSQE_FIXED_FILE | IOSQE_CQE_SKIP_SUCCESS;
+    }
+    static int64_t clock_ms() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+    // connections that went quiet since the last sweep give back their spare buffers
+    // each one once per quiet spell, found through their recv events
+    void sweep()
+    {
+        int64_t idle = idle_ms_;
+        for (auto &event : eventPool_.myPool())
+            if (event.type == 1 && now_ - event.lastActive >= idle && lastSweep_ - event.lastActive < idle)
+                event.handler->reclaim();
+        lastSweep_ = now_;
+    }
+    inline int64_t sweepInterval() const noexcept { return std::max(idle_ms_ / 2, 1u); }
+    // a sweep every idle_ms / 2, 10 ms ticks while recvs are paused
+    // as the budget may drain on other rings without a completion here
+    int addTick()
+    {
+        if (isTicking_ || (idle_ms_ == 0 && paused_.empty()))
+            return 0;
+        io_uring_sqe *sqe = getSqe();
+        if (sqe == nullptr)
+            return -1;
+        int64_t interval = idle_ms_ > 0 ? sweepInterval() : 10;
+        if (!paused_.empty())
+            interval = std::min<int64_t>(interval, 10);
+        tick_.tv_sec = interval / 1000;
+        tick_.tv_nsec = (interval % 1000) * 1000000L;
+        io_uring_prep_timeout(sqe, &tick_, 0, 0);
+        io_uring_sqe_set_data(sqe, &tickEvent_);
+        isTicking_ = true;
+        return 0;
+    }
+    // over the soft limit a connection holding at least the average stops reading,
+    // over the hard limit it is shut down and its recv tears it down
+    // one in the middle of a message keeps reading below the hard limit, a paused
+    // one could never finish it and would hold its bytes for good
+    // isArmed the multishot recv is still armed and gets cancelled
+    void shed(Event *event, bool isArmed)
+    {
+        if (event->isPaused || (!budget_.isSoft() && !budget_.isHard()) ||
+            event->handler->charged() * handlerPool_.inUse() < budget_.used())
+            return;
+        if (budget_.isHard())
+        {
+            fprintf(stderr, "Budget Shed: %d\n", event->fd); //
+            shutdownFd(event->fd);
+            return;
+        }
+        if (event->handler->isAwaitingRecv())
+            return;
+        // the bytes stay in the socket, the receive window pushes back on the peer
+        event->isPaused = true;
+        if (isArmed)
+            cancelRecv(event);
+    }
+    int addWake()
+    {
+        if (wakeFd_ == -1)
+            return -1;
+        io_uring_sqe *sqe = io_uring_get_sqe(&uring_);
+        if (sqe == nullptr)
+            return -2;
+        io_uring_prep_read(sqe, wakeFd_, &wakeBuf_, sizeof(wakeBuf_), 0);
+        io_uring_sqe_set_data(sqe, &wakeEvent_);
         return 0;
     }
-    inline void stop() const noexcept { stopSource_.request_stop(); }
-
-private:
     int addAccept()
     {
         io_uring_sqe *sqe = io_uring_get_sqe(&uring_);
         if (sqe == nullptr)
             return -1;
-        io_uring_prep_accept(sqe, serInfo_.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (multishotAccept_ && fixedFiles_)
+            io_uring_prep_multishot_accept_direct(sqe, serInfo_.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        else if (multishotAccept_)
+            io_uring_prep_multishot_accept(sqe, serInfo_.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        else if (fixedFiles_)
+            io_uring_prep_accept_direct(sqe, serInfo_.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC, IORING_FILE_INDEX_ALLOC);
+        else
+            io_uring_prep_accept(sqe, serInfo_.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
         io_uring_sqe_set_data(sqe, &accEvent_);
         return 0;
     }
+    // pass fd to the least loaded worker ring, no locks shared between rings
+    int addHandover(int fd)
+    {
+        Proactor *worker = nullptr;
+        for (Proactor *w : workers_)
+            if (w->state_.load() == 1 && (worker == nullptr || w->load_.load() < worker->load_.load()))
+                worker = w;
+        if (worker == nullptr)
+        {
+            closeFd(fd);
+            return -1;
+        }
+        Event *event = eventPool_.acquire();
+        if (event == nullptr)
+        {
+            closeFd(fd);
+            return -2;
+        }
+        event->type = 5;
+        event->fd = fd;
+        event->worker = worker;
+        io_uring_sqe *sqe = io_uring_get_sqe(&uring_);
+        if (sqe == nullptr)
+        {
+            closeFd(fd);
+            eventPool_.release(event);
+            return -3;
+        }
+        ++worker->load_;
+        // the worker completion carries the fd, or the slot allocated in its table
+        if (fixedFiles_)
+            io_uring_prep_msg_ring_fd_alloc(sqe, worker->uring_.ring_fd, fd, reinterpret_cast<__u64>(&worker->handEvent_), 0);
+        else
+            io_uring_prep_msg_ring(sqe, worker->uring_.ring_fd, fd, reinterpret_cast<__u64>(&worker->handEvent_), 0);
+        io_uring_sqe_set_data(sqe, event);
+        return 0;
+    }
     int addRecv_multishot(int fd)
     {
         Handler *handler = handlerPool_.acquire();
         if (handler == nullptr)
         {
-            ::close(fd);
+            closeFd(fd);
             return -1;
         }
         Event *event = eventPool_.acquire();
         if (event == nullptr)
         {
-            ::close(fd);
+            closeFd(fd);
             handlerPool_.release(handler);
             return -2;
         }
         event->type = 1;
         event->fd = fd;
         event->handler = handler;
-        io_uring_sqe *sqe = io_uring_get_sqe(&uring_);
-        if (sqe == nullptr)
+        event->lastActive = now_;
+        handler->chargeTo(&budget_);
+        if constexpr (is_tls<Peer>)
         {
-            ::close(fd);
+            event->ssl = newSsl();
+            if (event->ssl == nullptr)
+            {
+                closeFd(fd);
+                handlerPool_.release(handler);
+                eventPool_.release(event);
+                return -4;
+            }
+        }
+        if (!freeSendBufs_.empty())
+        {
+            int index = freeSendBufs_.back();
+            freeSendBufs_.pop_back();
+            handler->lendSendBuffer(sendBufBase_ + index * sendBufSize_, sendBufSize_, index);
+        }
+        if (armRecv(event) < 0)
+        {
+            closeFd(fd);
+            if (handler->sendBufferIndex() >= 0)
+                freeSendBufs_.push_back(handler->sendBufferIndex());
+            SSL_free(event->ssl);
             handlerPool_.release(handler);
             eventPool_.release(event);
             return -3;
         }
-        io_uring_prep_recv_multishot(sqe, fd, nullptr, 0, 0);
-        sqe->buf_group = bgid_;
+        handler->ref();
+        return 0;
+    }
+    int armRecv(Event *event)
+    {
+        io_uring_sqe *sqe = getSqe();
+        if (sqe == nullptr)
+            return -1;
+        event->group = event->nextGroup;
+        io_uring_prep_recv_multishot(sqe, event->fd, nullptr, 0, 0);
+        sqe->buf_group = bufGroups_[event->group].bgid;
+        if (recvBundle_)
+            sqe->ioprio |= IORING_RECVSEND_BUNDLE;
         sqe->flags |= IOSQE_BUFFER_SELECT;
+        if (fixedFiles_)
+            sqe->flags |= IOSQE_FIXED_FILE;
         io_uring_sqe_set_data(sqe, event);
         return 0;
     }
-    int addSend(int fd, Handler *handler)
+    // the recv completes with -ECANCELED and is re-armed with event->nextGroup
+    void cancelRecv(Event *event)
+    {
+        io_uring_sqe *sqe = getSqe();
+        if (sqe == nullptr)
+            return;
+        io_uring_prep_cancel64(sqe, reinterpret_cast<__u64>(event), 0);
+        io_uring_sqe_set_data(sqe, &ignEvent_);
+        sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+    }
+    // on failure the fd is shut down and the multishot recv owns the teardown
+    // ssl the connection's, carried to the completion for TLS
+    int addSend(int fd, Handler *handler, SSL *ssl = nullptr)
     {
         if (handler == nullptr)
-        {
-            ::close(fd);
             return -1;
-        }
         Event *event = eventPool_.acquire();
         if (event == nullptr)
         {
-            ::close(fd);
-            handlerPool_.release(handler);
+            shutdownFd(fd);
             return -2;
         }
-        event->type = 2;
-        event->fd = fd;
-        event->handler = handler;
         io_uring_sqe *sqe = io_uring_get_sqe(&uring_);
         if (sqe == nullptr)
         {
-            ::close(fd);
-            handlerPool_.release(handler);
+            shutdownFd(fd);
             eventPool_.release(event);
             return -3;
         }
         const char *data = handler->responseBegin();
         size_t length = handler->responseLength();
-        io_uring_prep_send(sqe, fd, data, length, MSG_NOSIGNAL);
+        // registered pages are never pinned per send
+        if (handler->responseIndex() >= 0)
+        {
+            event->type = 6;
+            io_uring_prep_send_zc_fixed(sqe, fd, data, length, MSG_NOSIGNAL, 0, handler->responseIndex());
+        }
+        else if (sendZcThreshold_ != 0 && length >= sendZcThreshold_)
+        {
+            event->type = 6;
+            io_uring_prep_send_zc(sqe, fd, data, length, MSG_NOSIGNAL, 0);
+        }
+        else
+        {
+            event->type = 2;
+            io_uring_prep_send(sqe, fd, data, length, MSG_NOSIGNAL);
+        }
+        if (fixedFiles_)
+            sqe->flags |= IOSQE_FIXED_FILE;
+        event->fd = fd;
+        event->handler = handler;
+        event->ssl = ssl;
         io_uring_sqe_set_data(sqe, event);
+        handler->ref();
         return 0;
     }
-};
\ No newline at end of file
+};
+// one Proactor ring per thread
+// acceptorRing true: a dedicated ring accepts and hands fds to the least loaded
+// worker ring with IORING_OP_MSG_RING
+// acceptorRing false: every ring accepts on its own SO_REUSEPORT listener
+template <typename Peer, is_protocol Protocol = Reflect>
+class MultiProactor
+{
+    Proactor<Peer, Protocol> acceptor_;
+    std::vector<std::unique_ptr<Proactor<Peer, Protocol>>> workers_;
+    bool acceptorRing_ = true;
+
+public:
+    explicit MultiProactor(unsigned int threads = std::thread::hardware_concurrency(), bool acceptorRing = true)
+        : acceptorRing_(acceptorRing)
+    {
+        if (threads == 0)
+            threads = 1;
+        workers_.reserve(threads);
+        for (unsigned int i = 0; i < threads; ++i)
+        {
+            workers_.push_back(std::make_unique<Proactor<Peer, Protocol>>());
+            if (acceptorRing_)
+            {
+                workers_.back()->isWorker_ = true;
+                acceptor_.workers_.push_back(workers_.back().get());
+            }
+        }
+    }
+    ~MultiProactor() noexcept { stop(); }
+    MultiProactor(const MultiProactor &) = delete;
+    MultiProactor &operator=(const MultiProactor &) = delete;
+    MultiProactor(MultiProactor &&) noexcept = delete;
+    MultiProactor &operator=(MultiProactor &&) noexcept = delete;
+    // same arguments and return values as Proactor::run()
+    // the acceptor ring, or the first worker ring, runs on the calling thread
+    // any ring failing stops all the others
+    template <typename... Args>
+    int run(Args... args)
+    {
+        std::vector<int> results(workers_.size() + 1, 0);
+        {
+            std::vector<std::jthread> loops;
+            loops.reserve(workers_.size());
+            for (size_t i = acceptorRing_ ? 0 : 1; i < workers_.size(); ++i)
+                loops.emplace_back([this, &results, i, args...]
+                                   {
+                                       results[i] = workers_[i]->run(args...);
+                                       stop(); });
+            if (acceptorRing_)
+            {
+                for (auto &worker : workers_)
+                    worker->state_.wait(0);
+                results.back() = acceptor_.run(args...);
+            }
+            else
+                results[0] = workers_[0]->run(args...);
+            stop();
+        }
+        for (int n : results)
+            if (n < 0)
+                return n;
+        return 0;
+    }
+    inline size_t threads() const noexcept { return workers_.size(); }
+    inline Protocol &protocol(size_t thread) noexcept { return workers_[thread]->protocol(); }
+    // every worker ring, see Proactor<Peer, Protocol>::reclaimIdle()
+    inline void reclaimIdle(unsigned int idle_ms, size_t retain = 256 * Handler::recvChunkSize) noexcept
+    {
+        for (auto &worker : workers_)
+            worker->reclaimIdle(idle_ms, retain);
+    }
+    // every worker ring, see Proactor<Peer, Protocol>::memoryBudget()
+    inline void memoryBudget(size_t soft, size_t hard) noexcept
+    {
+        for (auto &worker : workers_)
+            worker->memoryBudget(soft, hard);
+    }
+    inline void stop() const noexcept
+    {
+        acceptor_.stop();
+        for (auto &worker : workers_)
+            worker->stop();
+    }
+};
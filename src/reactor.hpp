@@ -6,10 +6,16 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <string>
 #include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
 #include <cstdlib>
 #include <stop_token>
+#include <chrono>
+#include <algorithm>
 #include "concepts.hpp"
 
 template <typename Peer>
@@ -23,11 +29,17 @@ struct TEvent<Peer>
 {
     int fd = -1;
     uint32_t events = 0;
+    // loop clock of the last readiness, ms
+    int64_t lastActive = 0;
+    // reads wait for the memory budget to drain
+    bool isPaused = false;
     Handler handler{};
     inline void reset() noexcept
     {
         fd = -1;
         events = 0;
+        lastActive = 0;
+        isPaused = false;
         handler.reset();
     }
 };
@@ -37,21 +49,216 @@ struct TEvent<Peer>
     int fd = -1;
     SSL *ssl = nullptr;
     uint32_t events = 0;
+    // SSL_accept() still in progress, driven by epoll readiness
+    bool isHandshaking = false;
+    // 0-RTT data still being read ahead of the handshake
+    bool isEarly = false;
+    // loop clock of the last readiness, ms
+    int64_t lastActive = 0;
+    // reads wait for the memory budget to drain
+    bool isPaused = false;
     Handler handler{};
     inline void reset() noexcept
     {
         fd = -1;
+        ssl = nullptr;
         events = 0;
+        lastActive = 0;
+        isPaused = false;
+        isHandshaking = false;
+        isEarly = false;
         handler.reset();
     }
 };
-template <typename Peer>
+// SSL_accept() off the event loop, one epoll per thread
+// finished connections are posted back and the owner's eventfd is written
+// a failed handshake comes back with its ssl freed and its fd closed
+// each thread answers 0-RTT data with its own Protocol
+template <typename Event, is_protocol Protocol = Reflect>
+class HandshakePool
+{
+    struct Worker
+    {
+        Protocol protocol{};
+        int epollFd = -1;
+        int wakeFd = -1;
+        std::mutex mutex;
+        std::vector<Event *> inbox;
+        std::jthread thread;
+    };
+    std::vector<std::unique_ptr<Worker>> workers_;
+    size_t next_ = 0;
+    std::mutex mutex_;
+    std::vector<Event *> done_;
+    int doneFd_ = -1;
+
+public:
+    HandshakePool() noexcept = default;
+    ~HandshakePool() noexcept { stop(); }
+    HandshakePool(const HandshakePool &) = delete;
+    HandshakePool &operator=(const HandshakePool &) = delete;
+    HandshakePool(HandshakePool &&) noexcept = delete;
+    HandshakePool &operator=(HandshakePool &&) noexcept = delete;
+    // 0 success
+    // -1 epoll_create1() error
+    // -2 eventfd() error
+    // -3 epoll_ctl() error
+    int start(unsigned int threads, int doneFd)
+    {
+        doneFd_ = doneFd;
+        for (unsigned int i = 0; i < threads; ++i)
+        {
+            auto worker = std::make_unique<Worker>();
+            worker->epollFd = epoll_create1(EPOLL_CLOEXEC);
+            if (worker->epollFd < 0)
+            {
+                stop();
+                return -1;
+            }
+            worker->wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (worker->wakeFd < 0)
+            {
+                ::close(worker->epollFd);
+                stop();
+                return -2;
+            }
+            epoll_event waker;
+            waker.events = EPOLLIN;
+            waker.data.ptr = nullptr;
+            if (epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, worker->wakeFd, &waker) < 0)
+            {
+                ::close(worker->wakeFd);
+                ::close(worker->epollFd);
+                stop();
+                return -3;
+            }
+            Worker *w = worker.get();
+            worker->thread = std::jthread([this, w](std::stop_token token)
+                                          { work(token, *w); });
+            workers_.push_back(std::move(worker));
+        }
+        return 0;
+    }
+    void stop() noexcept
+    {
+        for (auto &worker : workers_)
+        {
+            worker->thread.request_stop();
+            eventfd_write(worker->wakeFd, 1);
+            if (worker->thread.joinable())
+                worker->thread.join();
+            ::close(worker->wakeFd);
+            ::close(worker->epollFd);
+        }
+        workers_.clear();
+    }
+    void submit(Event *event)
+    {
+        Worker &worker = *workers_[next_++ % workers_.size()];
+        {
+            std::lock_guard lock(worker.mutex);
+            worker.inbox.push_back(event);
+        }
+        eventfd_write(worker.wakeFd, 1);
+    }
+    template <typename OnDone>
+    void drain(OnDone &&onDone)
+    {
+        std::vector<Event *> done;
+        {
+            std::lock_guard lock(mutex_);
+            done.swap(done_);
+        }
+        for (Event *event : done)
+            onDone(event);
+    }
+
+private:
+    void work(std::stop_token token, Worker &worker)
+    {
+        epoll_event events[64];
+        std::vector<Event *> inbox;
+        while (!token.stop_requested())
+        {
+            int n = epoll_wait(worker.epollFd, events, 64, -1);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                fprintf(stderr, "HandshakePool epoll_wait() Error\n"); //
+                return;
+            }
+            for (int i = 0; i < n; ++i)
+            {
+                Event *event = reinterpret_cast<Event *>(events[i].data.ptr);
+                if (event != nullptr)
+                {
+                    step(worker, event);
+                    continue;
+                }
+                eventfd_t value;
+                eventfd_read(worker.wakeFd, &value);
+                {
+                    std::lock_guard lock(worker.mutex);
+                    inbox.swap(worker.inbox);
+                }
+                for (Event *event : inbox)
+                {
+                    epoll_event waiter;
+                    waiter.events = EPOLLIN | EPOLLOUT | EPOLLET;
+                    waiter.data.ptr = event;
+                    if (epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, event->fd, &waiter) < 0)
+                        finish(event, false);
+                    else
+                        step(worker, event);
+                }
+                inbox.clear();
+            }
+        }
+    }
+    void step(Worker &worker, Event *event)
+    {
+        int n = Peer_tls::handshake(event->ssl, event->isEarly, event->handler, worker.protocol);
+        if (n > 0)
+            return;
+        epoll_ctl(worker.epollFd, EPOLL_CTL_DEL, event->fd, nullptr);
+        finish(event, n == 0);
+    }
+    void finish(Event *event, bool isDone)
+    {
+        if (isDone)
+            event->isHandshaking = false;
+        else
+        {
+            SSL_free(event->ssl);
+            ::close(event->fd);
+            event->ssl = nullptr;
+            event->fd = -1;
+        }
+        {
+            std::lock_guard lock(mutex_);
+            done_.push_back(event);
+        }
+        eventfd_write(doneFd_, 1);
+    }
+};
+// Protocol answers what every connection receives, see is_protocol
+template <typename Peer, is_protocol Protocol = Reflect>
 class Reactor : private Peer
 {
     int epollFd_ = -1;
     epoll_event *newEventBuf_ = nullptr;
     using Event = TEvent<Peer>;
     Event accEvent_{};
+    int wakeFd_ = -1;
+    Event wakeEvent_{};
+    std::unique_ptr<HandshakePool<Event, Protocol>> handshakePool_;
+    Protocol protocol_{};
+    // see reclaimIdle()
+    unsigned int idle_ms_ = 0;
+    size_t retain_ = 256 * Handler::recvChunkSize;
+    int64_t now_ = 0;
+    int64_t lastSweep_ = 0;
     template <Resettable Obj>
     class ObjPool
     {
@@ -89,17 +296,45 @@ class Reactor : private Peer
             }
         }
         inline std::vector<Obj> &myPool() noexcept { return pool_; }
+        inline size_t inUse() const noexcept { return pool_.size() - available_.size(); }
     };
+    // every handler in use is charged here, destroyed after them
+    Budget budget_{&Budget::process()};
+    // connections whose reads wait for budget_ to drain
+    std::vector<Event *> paused_;
     ObjPool<Event> eventPool_;
     std::stop_source stopSource_;
 
 public:
-    Reactor() noexcept = default;
-    ~Reactor() noexcept { stop(); }
+    Reactor() noexcept
+    {
+        wakeFd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        wakeEvent_.fd = wakeFd_;
+    }
+    ~Reactor() noexcept
+    {
+        stop();
+        ::close(wakeFd_);
+    }
     Reactor(const Reactor &) = delete;
     Reactor &operator=(const Reactor &) = delete;
     Reactor(Reactor &&) noexcept = delete;
     Reactor &operator=(Reactor &&) noexcept = delete;
+    // the loop's own instance, configure it before run()
+    inline Protocol &protocol() noexcept { return protocol_; }
+    // connections idle for idle_ms give back their spare buffers, see Handler::reclaim(), 0 never
+    // the loop keeps at most retain bytes of drained receive chunks for reuse
+    // configure it before run()
+    inline void reclaimIdle(unsigned int idle_ms, size_t retain = 256 * Handler::recvChunkSize) noexcept
+    {
+        idle_ms_ = idle_ms;
+        retain_ = retain;
+    }
+    // the loop's buffered bytes, see Budget, 0 no limit
+    // the process-wide limits are set on Budget::process()
+    // configure it before run()
+    inline void memoryBudget(size_t soft, size_t hard) noexcept { budget_.limit(soft, hard); }
+    inline const Budget &budget() const noexcept { return budget_; }
     // 0 success
     // -1 ip error
     // -2 port error
@@ -137,11 +372,24 @@ public:
             Peer::serInfo_ = {};
             return -9;
         }
+        epoll_event waker;
+        waker.events = EPOLLIN;
+        waker.data.ptr = &wakeEvent_;
+        if (wakeFd_ != -1 && epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &waker) < 0)
+        {
+            ::close(epollFd_);
+            ::close(Peer::serInfo_.fd);
+            Peer::serInfo_ = {};
+            return -9;
+        }
         newEventBuf_ = new epoll_event[maxBufEntrs];
         eventPool_.init(eventPoolSize);
+        Handler::recvSlabCapacity(retain_ / Handler::recvChunkSize);
         while (!stopSource_.stop_requested())
         {
-            n = epoll_wait(epollFd_, newEventBuf_, maxBufEntrs, -1);
+            n = epoll_wait(epollFd_, newEventBuf_, maxBufEntrs, sweepTimeout());
+            if (idle_ms_ > 0)
+                now_ = clock_ms();
             if (n < 0)
             {
                 if (errno == EINTR)
@@ -155,6 +403,8 @@ public:
             {
                 Event *event = reinterpret_cast<Event *>(newEventBuf_[i].data.ptr);
                 int e = 0;
+                if (event == &wakeEvent_)
+                    continue;
                 if (event->fd == Peer::serInfo_.fd)
                 {
                     int fd = Peer::accept(recvTimeout_s, recvTimeout_us);
@@ -163,10 +413,18 @@ public:
                         fprintf(stderr, "Peer::accept() Error: %d\n", fd); //
                         continue;
                     }
+                    // over the hard limit, refused
+                    if (budget_.isHard())
+                    {
+                        ::close(fd);
+                        continue;
+                    }
                     Event *recvEvent = eventPool_.acquire();
                     if (recvEvent == nullptr)
                         continue;
                     recvEvent->fd = fd;
+                    recvEvent->lastActive = now_;
+                    recvEvent->handler.chargeTo(&budget_);
                     recvEvent->events |= (EPOLLIN | EPOLLET);
                     epoll_event recver;
                     recver.events = recvEvent->events;
@@ -180,21 +438,25 @@ public:
                 }
                 else
                 {
+                    event->lastActive = now_;
                     if (newEventBuf_[i].events & EPOLLIN)
                     {
                         int fd = event->fd;
                         Handler &handler = event->handler;
-                        char buf[4096]{0};
                         ssize_t rn = 0;
                         do
                         {
-                            rn = Peer::recv(fd, buf, sizeof(buf));
+                            if (shed(event) != 0)
+                                break;
+                            rn = Peer::recv(fd, handler, Handler::recvChunkSize);
                             if (rn >= 0)
                             {
                                 if (rn == 0)
                                     break;
-                                handler.appendRecvStream(buf, rn);
-                                handler.process_reflect();
+                                handler.process(protocol_);
+                                int lowat = 1;
+                                if (handler.updateRecvLowat(lowat))
+                                    setsockopt(fd, SOL_SOCKET, SO_RCVLOWAT, &lowat, sizeof(lowat));
                                 if (handler.isResponse())
                                 {
                                     event->events |= (EPOLLOUT | EPOLLET);
@@ -208,27 +470,43 @@ public:
                                         goto error;
                                     }
                                 }
+                                else if (handler.isClosed())
+                                {
+                                    closeConn(event);
+                                    break;
+                                }
                             }
                             else
                             {
                                 epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
                                 eventPool_.release(event);
-                                if (rn != 0)
+                                // -3 a plain EOF
+                                if (rn != -3)
                                     fprintf(stderr, "Peer::recv() Error: %ld\n", rn); //
                                 rn = 0;
                             }
-                        } while (rn >= sizeof(buf));
+                        } while (rn >= static_cast<ssize_t>(Handler::recvChunkSize));
                     }
-                    else if (newEventBuf_[i].events & EPOLLOUT)
+                    // an edge-triggered EPOLLOUT that came with EPOLLIN is not reported again
+                    // a released event has its fd reset
+                    if ((newEventBuf_[i].events & EPOLLOUT) && event->fd != -1)
                     {
                         int fd = event->fd;
                         Handler &handler = event->handler;
-                        ssize_t sn = 0;
-                        do
+                        // one sendmsg() over the queued segments per round
+                        // a short write leaves EPOLLOUT armed for the next edge
+                        while (true)
                         {
-                            sn = Peer::send(fd, handler.responseBegin(), handler.responseLength());
-                            if (sn >= 0)
+                            iovec iov[64];
+                            size_t count = handler.responseIov(iov, sizeof(iov) / sizeof(iov[0]));
+                            if (count == 0 || !handler.isSending())
                             {
+                                handler.stillSending(0);
+                                if (handler.isClosed())
+                                {
+                                    closeConn(event);
+                                    break;
+                                }
                                 event->events &= ~EPOLLOUT;
                                 epoll_event sender;
                                 sender.events = event->events;
@@ -239,22 +517,34 @@ public:
                                     eventPool_.release(event);
                                     goto error;
                                 }
+                                break;
                             }
-                            else
+                            size_t len = 0;
+                            for (size_t j = 0; j < count; ++j)
+                                len += iov[j].iov_len;
+                            ssize_t sn = Peer::send(fd, iov, count);
+                            if (sn < 0)
                             {
                                 epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
                                 eventPool_.release(event);
                                 fprintf(stderr, "Peer::send() Error: %ld\n", sn); //
+                                break;
                             }
-                        } while (handler.stillSending(sn));
+                            if (handler.stillSending(sn) && static_cast<size_t>(sn) < len)
+                                break;
+                        }
                     }
-                    else if (newEventBuf_[i].events & EPOLLERR)
+                    else if (!(newEventBuf_[i].events & EPOLLIN) && (newEventBuf_[i].events & EPOLLERR))
                     {
                     error:
                         fprintf(stderr, "Event Error: %d\n", e); //
                     }
                 }
             }
+            if (idle_ms_ > 0 && now_ - lastSweep_ >= sweepInterval())
+                sweep();
+            if (!paused_.empty() && !budget_.isSoft())
+                resume();
         }
         if (Peer::serInfo_.fd != -1)
         {
@@ -296,12 +586,17 @@ public:
     // -12 epoll_create1() error
     // -13 epoll_ctl() error
     // -14 epoll_wait() error
+    // -15 HandshakePool::start() error
+    // handshakeThreads SSL_accept() runs on this many threads instead of the loop, 0 inline
+    // isKtls record crypto moves to the kernel, file responses go out with sendfile()
+    // maxEarlyData 0-RTT bytes read ahead of the handshake, see Handler::earlyLength(), 0 none
     int run(const char *ip, int port, const char *crt, const char *key, int backlog = 511,
             int recvTimeout_s = 3, int recvTimeout_us = 0,
-            unsigned int eventPoolSize = 1024, unsigned int maxBufEntrs = 1024)
+            unsigned int eventPoolSize = 1024, unsigned int maxBufEntrs = 1024,
+            unsigned int handshakeThreads = 0, bool isKtls = false, uint32_t maxEarlyData = 0)
         requires is_tls<Peer>
     {
-        int n = Peer::listen(ip, port, crt, key, backlog);
+        int n = Peer::listen(ip, port, crt, key, backlog, isKtls, maxEarlyData);
         if (n < 0)
             return n;
         accEvent_.fd = Peer::serInfo_.fd;
@@ -324,15 +619,43 @@ public:
             Peer::serInfo_ = {};
             return -13;
         }
+        epoll_event waker;
+        waker.events = EPOLLIN;
+        waker.data.ptr = &wakeEvent_;
+        if (wakeFd_ != -1 && epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &waker) < 0)
+        {
+            ::close(epollFd_);
+            ::close(Peer::serInfo_.fd);
+            SSL_CTX_free(Peer::serInfo_.ctx);
+            Peer::serInfo_ = {};
+            return -13;
+        }
+        if (handshakeThreads > 0)
+        {
+            handshakePool_ = std::make_unique<HandshakePool<Event, Protocol>>();
+            if (wakeFd_ == -1 || handshakePool_->start(handshakeThreads, wakeFd_) < 0)
+            {
+                handshakePool_.reset();
+                ::close(epollFd_);
+                ::close(Peer::serInfo_.fd);
+                SSL_CTX_free(Peer::serInfo_.ctx);
+                Peer::serInfo_ = {};
+                return -15;
+            }
+        }
         newEventBuf_ = new epoll_event[maxBufEntrs];
         eventPool_.init(eventPoolSize);
+        Handler::recvSlabCapacity(retain_ / Handler::recvChunkSize);
         while (!stopSource_.stop_requested())
         {
-            n = epoll_wait(epollFd_, newEventBuf_, maxBufEntrs, -1);
+            n = epoll_wait(epollFd_, newEventBuf_, maxBufEntrs, sweepTimeout());
+            if (idle_ms_ > 0)
+                now_ = clock_ms();
             if (n < 0)
             {
                 if (errno == EINTR)
                     continue;
+                handshakePool_.reset();
                 ::close(epollFd_);
                 ::close(Peer::serInfo_.fd);
                 SSL_CTX_free(Peer::serInfo_.ctx);
@@ -343,51 +666,98 @@ public:
             {
                 Event *event = reinterpret_cast<Event *>(newEventBuf_[i].data.ptr);
                 int e = 0;
+                if (event == &wakeEvent_)
+                {
+                    // a stop request stays visible through stopSource_
+                    if (handshakePool_ != nullptr)
+                    {
+                        eventfd_t value;
+                        eventfd_read(wakeFd_, &value);
+                        handshakePool_->drain([this](Event *event)
+                                              { handshaken(event); });
+                    }
+                    continue;
+                }
                 if (event->fd == Peer::serInfo_.fd)
                 {
-                    SSL *ssl = Peer::accept(recvTimeout_s, recvTimeout_us);
+                    // the handshake runs from epoll readiness, a slow client never blocks the loop
+                    SSL *ssl = Peer::accept(recvTimeout_s, recvTimeout_us, false);
                     if (ssl == nullptr)
                     {
                         fprintf(stderr, "Peer::accept() Error\n"); //
                         continue;
                     }
                     int fd = SSL_get_fd(ssl);
+                    // over the hard limit, refused
+                    if (budget_.isHard())
+                    {
+                        SSL_free(ssl);
+                        ::close(fd);
+                        continue;
+                    }
                     Event *recvEvent = eventPool_.acquire();
                     if (recvEvent == nullptr)
+                    {
+                        SSL_free(ssl);
+                        ::close(fd);
                         continue;
+                    }
                     recvEvent->ssl = ssl;
                     recvEvent->fd = fd;
+                    recvEvent->lastActive = now_;
+                    recvEvent->handler.chargeTo(&budget_);
+                    recvEvent->isHandshaking = true;
+                    recvEvent->isEarly = SSL_get_max_early_data(ssl) > 0;
+                    if (handshakePool_ != nullptr)
+                    {
+                        handshakePool_->submit(recvEvent);
+                        continue;
+                    }
                     recvEvent->events |= (EPOLLIN | EPOLLET);
                     epoll_event recver;
                     recver.events = recvEvent->events;
                     recver.data.ptr = recvEvent;
                     if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &recver) < 0)
                     {
-                        SSL_shutdown(ssl);
                         SSL_free(ssl);
                         ::close(fd);
                         eventPool_.release(recvEvent);
                         goto error;
                     }
+                    // the ClientHello is often already queued
+                    e = handshake(recvEvent);
+                    if (e < 0)
+                        goto error;
                 }
                 else
                 {
+                    event->lastActive = now_;
+                    if (event->isHandshaking)
+                    {
+                        e = handshake(event);
+                        if (e < 0)
+                            goto error;
+                        if (e > 0)
+                            continue;
+                        // records that came with the client Finished
+                        newEventBuf_[i].events |= EPOLLIN;
+                    }
                     if (newEventBuf_[i].events & EPOLLIN)
                     {
                         SSL *&ssl = event->ssl;
                         int fd = event->fd;
                         Handler &handler = event->handler;
-                        char buf[4096]{0};
                         ssize_t rn = 0;
                         do
                         {
-                            rn = Peer::recv(ssl, buf, sizeof(buf));
+                            if (shed(event) != 0)
+                                break;
+                            rn = Peer::recv(ssl, handler, Handler::recvChunkSize);
                             if (rn >= 0)
                             {
                                 if (rn == 0)
                                     break;
-                                handler.appendRecvStream(buf, rn);
-                                handler.process_reflect();
+                                handler.process(protocol_);
                                 if (handler.isResponse())
                                 {
                                     event->events |= (EPOLLOUT | EPOLLET);
@@ -401,6 +771,11 @@ public:
                                         goto error;
                                     }
                                 }
+                                else if (handler.isClosed())
+                                {
+                                    closeConn(event);
+                                    break;
+                                }
                             }
                             else
                             {
@@ -410,46 +785,96 @@ public:
                                     fprintf(stderr, "Peer::recv() Error: %ld\n", rn); //
                                 rn = 0;
                             }
-                        } while (rn >= sizeof(buf));
+                        } while (rn >= static_cast<ssize_t>(Handler::recvChunkSize));
                     }
-                    else if (newEventBuf_[i].events & EPOLLOUT)
+                    // an edge-triggered EPOLLOUT that came with EPOLLIN is not reported again
+                    // a released event has its fd reset
+                    if ((newEventBuf_[i].events & EPOLLOUT) && event->fd != -1)
                     {
                         SSL *&ssl = event->ssl;
                         int fd = event->fd;
                         Handler &handler = event->handler;
                         ssize_t sn = 0;
-                        do
+                        if (!handler.isSendingFile())
                         {
-                            sn = Peer::send(ssl, handler.responseBegin(), handler.responseLength());
-                            if (sn >= 0)
+                            do
                             {
-                                event->events &= ~EPOLLOUT;
-                                epoll_event sender;
-                                sender.events = event->events;
-                                sender.data.ptr = event;
-                                if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, event->fd, &sender) < 0)
+                                sn = Peer::send(ssl, handler.responseBegin(), handler.responseLength());
+                                if (sn >= 0)
+                                {
+                                    event->events &= ~EPOLLOUT;
+                                    epoll_event sender;
+                                    sender.events = event->events;
+                                    sender.data.ptr = event;
+                                    if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, event->fd, &sender) < 0)
+                                    {
+                                        epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+                                        eventPool_.release(event);
+                                        goto error;
+                                    }
+                                }
+                                else
                                 {
                                     epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
                                     eventPool_.release(event);
-                                    goto error;
+                                    fprintf(stderr, "Peer::send() Error: %ld\n", sn); //
                                 }
+                            } while (handler.stillSending(sn));
+                        }
+                        if (sn >= 0 && handler.isClosed())
+                        {
+                            closeConn(event);
+                            continue;
+                        }
+                        // the file region goes after the buffered bytes
+                        if (sn >= 0 && handler.isSendingFile())
+                        {
+                            ssize_t fn = 0;
+                            do
+                                fn = Peer::sendfile(ssl, handler.responseFile(), handler.responseFileOffset(), handler.responseFileLength());
+                            while (handler.stillSendingFile(fn));
+                            if (fn < 0)
+                            {
+                                epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+                                eventPool_.release(event);
+                                fprintf(stderr, "Peer::sendfile() Error: %ld\n", fn); //
+                                continue;
+                            }
+                            if (fn > 0 && handler.isClosed())
+                            {
+                                closeConn(event);
+                                continue;
                             }
+                            // EAGAIN: the rest waits for the next EPOLLOUT
+                            if (fn == 0)
+                                event->events |= EPOLLOUT;
                             else
+                                event->events &= ~EPOLLOUT;
+                            epoll_event sender;
+                            sender.events = event->events;
+                            sender.data.ptr = event;
+                            if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, event->fd, &sender) < 0)
                             {
                                 epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
                                 eventPool_.release(event);
-                                fprintf(stderr, "Peer::send() Error: %ld\n", sn); //
+                                goto error;
                             }
-                        } while (handler.stillSending(sn));
+                        }
                     }
-                    else if (newEventBuf_[i].events & EPOLLERR)
+                    else if (!(newEventBuf_[i].events & EPOLLIN) && (newEventBuf_[i].events & EPOLLERR))
                     {
                     error:
                         fprintf(stderr, "Event Error: %d\n", e); //
                     }
                 }
             }
+            if (idle_ms_ > 0 && now_ - lastSweep_ >= sweepInterval())
+                sweep();
+            if (!paused_.empty() && !budget_.isSoft())
+                resume();
         }
+        // every event is back in the loop's hands once the pool has joined
+        handshakePool_.reset();
         if (Peer::cliInfo_.fd != -1)
         {
             epoll_ctl(epollFd_, EPOLL_CTL_DEL, Peer::cliInfo_.fd, nullptr);
@@ -462,7 +887,9 @@ public:
         if (Peer::serInfo_.fd != -1)
         {
             epoll_ctl(epollFd_, EPOLL_CTL_DEL, Peer::serInfo_.fd, nullptr);
-            SSL_shutdown(Peer::serInfo_.ssl);
+            // the listener has no ssl of its own
+            if (Peer::serInfo_.ssl != nullptr)
+                SSL_shutdown(Peer::serInfo_.ssl);
             SSL_free(Peer::serInfo_.ssl);
             ::close(Peer::serInfo_.fd);
             SSL_CTX_free(Peer::serInfo_.ctx);
@@ -481,10 +908,239 @@ public:
         for (auto &event : eventPool_.myPool())
             if (event.fd != -1)
             {
+                SSL_free(event.ssl);
                 ::close(event.fd);
                 event.fd = -1;
+                event.ssl = nullptr;
+            }
+        return 0;
+    }
+    inline void stop() const noexcept
+    {
+        stopSource_.request_stop();
+        if (wakeFd_ != -1)
+            eventfd_write(wakeFd_, 1);
+    }
+
+private:
+    static int64_t clock_ms() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+    inline int64_t sweepInterval() const noexcept { return std::max(idle_ms_ / 2, 1u); }
+    // epoll_wait() wakes up for the next sweep, -1 no sweeps
+    // paused reads are looked at every 10 ms, the budget may drain on other loops
+    inline int sweepTimeout() const noexcept
+    {
+        int timeout = -1;
+        if (idle_ms_ > 0)
+            timeout = static_cast<int>(std::clamp<int64_t>(lastSweep_ + sweepInterval() - now_, 0, sweepInterval()));
+        if (!paused_.empty())
+            timeout = timeout < 0 ? 10 : std::min(timeout, 10);
+        return timeout;
+    }
+    // over the soft limit a connection holding at least the average stops reading,
+    // over the hard limit it is closed
+    // one in the middle of a message keeps reading below the hard limit, a paused
+    // one could never finish it and would hold its bytes for good
+    // 0 read on
+    // 1 paused, see resume()
+    // -1 closed
+    int shed(Event *event)
+    {
+        if ((!budget_.isSoft() && !budget_.isHard()) ||
+            event->handler.charged() * eventPool_.inUse() < budget_.used())
+            return 0;
+        if (budget_.isHard())
+        {
+            fprintf(stderr, "Budget Shed: %d\n", event->fd); //
+            closeConn(event);
+            return -1;
+        }
+        if (event->handler.isAwaitingRecv())
+            return 0;
+        // the pending bytes stay in the socket, the receive window pushes back on the peer
+        event->isPaused = true;
+        event->events &= ~EPOLLIN;
+        epoll_event waiter;
+        waiter.events = event->events;
+        waiter.data.ptr = event;
+        epoll_ctl(epollFd_, EPOLL_CTL_MOD, event->fd, &waiter);
+        paused_.push_back(event);
+        return 1;
+    }
+    // re-arming EPOLLIN reports the bytes that arrived while paused
+    // an event released meanwhile is no longer isPaused
+    void resume()
+    {
+        for (Event *event : paused_)
+        {
+            if (!event->isPaused)
+                continue;
+            event->isPaused = false;
+            event->events |= EPOLLIN;
+            epoll_event waiter;
+            waiter.events = event->events;
+            waiter.data.ptr = event;
+            if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, event->fd, &waiter) < 0)
+            {
+                fprintf(stderr, "Event Error: %d\n", -1); //
+                closeConn(event);
             }
+        }
+        paused_.clear();
+    }
+    // connections that went quiet since the last sweep give back their spare buffers
+    // each one once per quiet spell, events 0 is free or still in the handshake pool
+    void sweep()
+    {
+        int64_t idle = idle_ms_;
+        for (auto &event : eventPool_.myPool())
+            if (event.events != 0 && now_ - event.lastActive >= idle && lastSweep_ - event.lastActive < idle)
+                event.handler.reclaim();
+        lastSweep_ = now_;
+    }
+    // a connection done with its responses after Handler::closeAfterResponse()
+    void closeConn(Event *event)
+    {
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, event->fd, nullptr);
+        if constexpr (is_tls<Peer>)
+        {
+            SSL_shutdown(event->ssl);
+            SSL_free(event->ssl);
+        }
+        ::close(event->fd);
+        eventPool_.release(event);
+    }
+    // a connection back from the handshake pool
+    // registering it reports records that came with the client Finished
+    void handshaken(Event *event)
+        requires is_tls<Peer>
+    {
+        if (event->ssl == nullptr)
+        {
+            eventPool_.release(event);
+            return;
+        }
+        event->events = EPOLLIN | EPOLLET;
+        // the rest of a 0.5-RTT answer
+        if (event->handler.isSending())
+            event->events |= EPOLLOUT;
+        epoll_event recver;
+        recver.events = event->events;
+        recver.data.ptr = event;
+        if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, event->fd, &recver) < 0)
+        {
+            fprintf(stderr, "Event Error: %d\n", -2); //
+            SSL_free(event->ssl);
+            ::close(event->fd);
+            eventPool_.release(event);
+        }
+    }
+    // 0 handshake done
+    // 1 still in progress, waiting on the direction SSL_accept() asked for
+    // -1 handshake failed, the connection is closed
+    // -2 epoll_ctl() error, the connection is closed
+    int handshake(Event *event)
+        requires is_tls<Peer>
+    {
+        int n = Peer::handshake(event->ssl, event->isEarly, event->handler, protocol_);
+        if (n < 0)
+        {
+            SSL_free(event->ssl);
+            ::close(event->fd);
+            eventPool_.release(event);
+            return -1;
+        }
+        uint32_t events = EPOLLIN | EPOLLET;
+        if (n == 0)
+        {
+            event->isHandshaking = false;
+            // the rest of a 0.5-RTT answer
+            if (event->handler.isSending())
+                events |= EPOLLOUT;
+        }
+        else if (n == 2)
+            events |= EPOLLOUT;
+        if (events != event->events)
+        {
+            event->events = events;
+            epoll_event waiter;
+            waiter.events = event->events;
+            waiter.data.ptr = event;
+            if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, event->fd, &waiter) < 0)
+            {
+                SSL_free(event->ssl);
+                ::close(event->fd);
+                eventPool_.release(event);
+                return -2;
+            }
+        }
+        return n == 0 ? 0 : 1;
+    }
+};
+// one Reactor<Peer, Protocol> loop per thread, each with its own SO_REUSEPORT listener
+template <typename Peer, is_protocol Protocol = Reflect>
+class MultiReactor
+{
+    std::vector<std::unique_ptr<Reactor<Peer, Protocol>>> reactors_;
+
+public:
+    explicit MultiReactor(unsigned int threads = std::thread::hardware_concurrency())
+    {
+        if (threads == 0)
+            threads = 1;
+        reactors_.reserve(threads);
+        for (unsigned int i = 0; i < threads; ++i)
+            reactors_.push_back(std::make_unique<Reactor<Peer, Protocol>>());
+    }
+    ~MultiReactor() noexcept { stop(); }
+    MultiReactor(const MultiReactor &) = delete;
+    MultiReactor &operator=(const MultiReactor &) = delete;
+    MultiReactor(MultiReactor &&) noexcept = delete;
+    MultiReactor &operator=(MultiReactor &&) noexcept = delete;
+    // same arguments and return values as Reactor<Peer, Protocol>::run()
+    // the first loop runs on the calling thread
+    // any loop failing stops all the others
+    template <typename... Args>
+    int run(Args... args)
+    {
+        std::vector<int> results(reactors_.size(), 0);
+        {
+            std::vector<std::jthread> loops;
+            loops.reserve(reactors_.size() - 1);
+            for (size_t i = 1; i < reactors_.size(); ++i)
+                loops.emplace_back([this, &results, i, args...]
+                                   {
+                                       results[i] = reactors_[i]->run(args...);
+                                       stop(); });
+            results[0] = reactors_[0]->run(args...);
+            stop();
+        }
+        for (int n : results)
+            if (n < 0)
+                return n;
         return 0;
     }
-    inline void stop() const noexcept { stopSource_.request_stop(); }
+    inline size_t threads() const noexcept { return reactors_.size(); }
+    inline Protocol &protocol(size_t thread) noexcept { return reactors_[thread]->protocol(); }
+    // every loop, see Reactor<Peer, Protocol>::reclaimIdle()
+    inline void reclaimIdle(unsigned int idle_ms, size_t retain = 256 * Handler::recvChunkSize) noexcept
+    {
+        for (auto &reactor : reactors_)
+            reactor->reclaimIdle(idle_ms, retain);
+    }
+    // every loop, see Reactor<Peer, Protocol>::memoryBudget()
+    inline void memoryBudget(size_t soft, size_t hard) noexcept
+    {
+        for (auto &reactor : reactors_)
+            reactor->memoryBudget(soft, hard);
+    }
+    inline void stop() const noexcept
+    {
+        for (auto &reactor : reactors_)
+            reactor->stop();
+    }
 };
\ No newline at end of file